@@ -4,33 +4,187 @@
 #ifndef CRAFT_XML_HPP
 #define CRAFT_XML_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
-#include <stack>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#if __has_include(<version>)
+    #include <version>
+#endif
+#ifdef __cpp_lib_ranges
+    #include <ranges>
+#endif
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+#include "Encoding.hpp"
 #include "MemoryPool.hpp"
 
 namespace Craft
 {
     class XMLNodeIterator;
 
+    // a namespace URI and a local name as ids of XMLNames, compared as two
+    // integers, namespaceId 0 is no namespace
+    struct XMLName
+    {
+        uint32_t namespaceId = 0;
+        uint32_t localId = 0;
+
+        bool operator==(const XMLName &) const = default;
+    };
+
+    // process wide ids of namespace URIs and local names, a string get the
+    // same id in every document and thread, so a XMLName made once can be
+    // compared with the names of any parsed document
+    // id 0 is the empty string, strings are never released
+    class XMLNames
+    {
+    public:
+        static constexpr std::string_view XMLNamespace =
+            "http://www.w3.org/XML/1998/namespace";
+
+        static uint32_t Namespace(std::string_view uri)
+        {
+            return Table<0>::Intern(uri);
+        }
+
+        static uint32_t Local(std::string_view name)
+        {
+            return Table<1>::Intern(name);
+        }
+
+        static XMLName Name(std::string_view uri, std::string_view local)
+        {
+            return {Namespace(uri), Local(local)};
+        }
+
+        // views stay valid until exit, an unknown id give ""
+        static std::string_view NamespaceURI(uint32_t id)
+        {
+            return Table<0>::String(id);
+        }
+
+        static std::string_view LocalName(uint32_t id)
+        {
+            return Table<1>::String(id);
+        }
+
+    private:
+        template<int Kind>
+        class Table
+        {
+        public:
+            static uint32_t Intern(std::string_view str)
+            {
+                // the parser intern a name per element, a thread first look
+                // in its own cache and lock only for a name new to it
+                thread_local std::unordered_map<std::string, uint32_t, Hash,
+                                                std::equal_to<>>
+                    cache;
+                if (auto it = cache.find(str); it != cache.end())
+                {
+                    return it->second;
+                }
+                auto &shared = _Shared();
+                uint32_t id;
+                {
+                    std::lock_guard lock(shared.mutex);
+                    auto it = shared.ids.find(str);
+                    if (it != shared.ids.end())
+                    {
+                        id = it->second;
+                    }
+                    else
+                    {
+                        id = static_cast<uint32_t>(shared.strings.size());
+                        shared.ids.emplace(shared.strings.emplace_back(str),
+                                           id);
+                    }
+                }
+                cache.emplace(str, id);
+                return id;
+            }
+
+            static std::string_view String(uint32_t id)
+            {
+                auto &shared = _Shared();
+                std::lock_guard lock(shared.mutex);
+                return id < shared.strings.size() ? shared.strings[id]
+                                                  : std::string_view();
+            }
+
+        private:
+            struct Hash
+            {
+                using is_transparent = void;
+
+                size_t operator()(std::string_view str) const noexcept
+                {
+                    return std::hash<std::string_view>()(str);
+                }
+            };
+
+            struct Shared
+            {
+                std::mutex mutex;
+                // a deque never move its strings, ids keep views of them
+                std::deque<std::string> strings {std::string()};
+                std::unordered_map<std::string_view, uint32_t> ids {{"", 0}};
+            };
+
+            static Shared &_Shared()
+            {
+                static Shared shared;
+                return shared;
+            }
+        };
+    };
+
     class XMLNode
     {
     protected:
         class XMLNodeStruct;
 
+        struct AttributeIndex;
+
         friend class XMLDocument;
 
         friend class XMLParser;
 
         friend class XMLNodeIterator;
 
+        friend class XMLSnapshot;
+
+        friend class XMLOverlay;
+
+        friend class XMLDiff;
+
+        friend class XMLDocumentCache;
+
+        friend class RecordSplitter;
+
         XMLNode(XMLNodeStruct* node) : _node(node) {}
 
     public:
@@ -48,10 +202,182 @@ namespace Craft
         };
         using Iterator = XMLNodeIterator;
         using XMLNodes = std::vector<XMLNode>;
+        // std::less<> allow lookup by string_view without a temporary string
+        using Attributes = std::map<std::string, std::string, std::less<>>;
+
+    protected:
+        // walks used by Range, First() return the first node of the walk and
+        // Next(node) the node after it, both return nullptr at the end
+        template<typename Match>
+        struct ChildWalk
+        {
+            XMLNodeStruct *parent;
+            Match match;
+
+            XMLNodeStruct *First() const noexcept
+            {
+                return _Skip(parent->_firstChild);
+            }
+
+            XMLNodeStruct *Next(XMLNodeStruct *node) const noexcept
+            {
+                return _Skip(node->_next);
+            }
+
+            XMLNodeStruct *_Skip(XMLNodeStruct *node) const noexcept
+            {
+                while (node != parent->_lastChild && !match(node))
+                {
+                    node = node->_next;
+                }
+                return node != parent->_lastChild ? node : nullptr;
+            }
+        };
+
+        struct AnyMatch
+        {
+            bool operator()(const XMLNodeStruct *) const noexcept
+            {
+                return true;
+            }
+        };
+
+        struct TagMatch
+        {
+            std::string_view tag;
+
+            bool operator()(const XMLNodeStruct *node) const noexcept
+            {
+                return node->_tag == tag;
+            }
+        };
+
+        struct NameMatch
+        {
+            XMLName name;
+
+            bool operator()(const XMLNodeStruct *node) const noexcept
+            {
+                return node->_localName == name.localId
+                       && node->_namespace == name.namespaceId;
+            }
+        };
+
+        struct TypeMatch
+        {
+            NodeType type;
+
+            bool operator()(const XMLNodeStruct *node) const noexcept
+            {
+                return node->_type == type;
+            }
+        };
+
+        struct DescendantWalk
+        {
+            XMLNodeStruct *root;
+
+            XMLNodeStruct *First() const noexcept
+            {
+                return _NextPreorder(root, root);
+            }
+
+            XMLNodeStruct *Next(XMLNodeStruct *node) const noexcept
+            {
+                return _NextPreorder(node, root);
+            }
+        };
+
+        struct AncestorWalk
+        {
+            XMLNodeStruct *node;
+
+            XMLNodeStruct *First() const noexcept { return node->_parent; }
+
+            XMLNodeStruct *Next(XMLNodeStruct *ancestor) const noexcept
+            {
+                return ancestor->_parent;
+            }
+        };
+
+    public:
+        // lazy range over the intrusive links of XMLNodeStruct,
+        // nothing is allocated while walking and it is a borrowed view,
+        // so it can be used in C++20 range pipelines
+        template<typename Walk>
+        class Range
+        {
+        public:
+            class Iterator
+            {
+            public:
+                using value_type = XMLNode;
+                using reference = XMLNode;
+                using pointer = void;
+                using difference_type = std::ptrdiff_t;
+                using iterator_category = std::forward_iterator_tag;
+
+                Iterator() = default;
+
+                Iterator(XMLNodeStruct *node, Walk walk) :
+                    _node(node), _walk(walk)
+                {
+                }
+
+                XMLNode operator*() const { return XMLNode(_node); }
+
+                Iterator &operator++() noexcept
+                {
+                    _node = _walk.Next(_node);
+                    return *this;
+                }
+
+                Iterator operator++(int) noexcept
+                {
+                    auto old = *this;
+                    ++*this;
+                    return old;
+                }
+
+                bool operator==(const Iterator &other) const noexcept
+                {
+                    return _node == other._node;
+                }
+
+                bool operator!=(const Iterator &other) const noexcept
+                {
+                    return _node != other._node;
+                }
+
+            private:
+                XMLNodeStruct *_node = nullptr;
+
+                Walk _walk {};
+            };
+
+            Range() = default;
+
+            explicit Range(Walk walk) : _walk(walk) {}
+
+            [[nodiscard]] Iterator begin() const
+            {
+                return Iterator(_walk.First(), _walk);
+            }
+
+            [[nodiscard]] Iterator end() const
+            {
+                return Iterator(nullptr, _walk);
+            }
+
+            [[nodiscard]] bool empty() const { return _walk.First() == nullptr; }
+
+        private:
+            Walk _walk {};
+        };
 
         XMLNode(const std::string& tag = "", const std::string& content = "",
                 NodeType type = NodeElement) :
-            _node(memPool.New(tag, content, type))
+            _node(_Pool().New(tag, content, type))
         {
         }
 
@@ -70,225 +396,1001 @@ namespace Craft
         }
 
         // node modified
+        // all of them are O(1) on the links, a document with an attribute
+        // index also update it for the moved subtree
+        // a child which already has a parent is moved, with its subtree
+
         void AddChild(XMLNode &child)
         {
-            if (_node->_firstChild == _node->_lastChild)
+            _Insert(child, _node->_lastChild);
+        }
+
+        // next is a child of this node
+        void InsertBefore(XMLNode &child, const XMLNode &next)
+        {
+            assert(next._node->_parent == _node);
+            if (child._node != next._node)
             {
-                // firstChild->next default nullptr
-                // firstChild->prev default reset()
-                // lastChild default point to firstChild(a empty node)
-                // so lastChild->next default nullptr
-                _node->_firstChild = child._node;
-                _node->_firstChild->_next = _node->_lastChild;
-                _node->_lastChild->_prev = _node->_firstChild;
-                // do in constructor
-                // _node->_firstChild->_prev.reset();
-                // _node->_lastChild->_next = nullptr;
+                _Insert(child, next._node);
             }
-            else
+        }
+
+        // prev is a child of this node
+        void InsertAfter(XMLNode &child, const XMLNode &prev)
+        {
+            assert(prev._node->_parent == _node);
+            // a child already after prev stay, next must not be itself
+            if (child._node != prev._node && child._node != prev._node->_next)
             {
-                child._node->_prev = _node->_lastChild->_prev;
-                child._node->_next = _node->_lastChild;
-                _node->_lastChild->_prev->_next = child._node;
-                _node->_lastChild->_prev = child._node;
+                _Insert(child, prev._node->_next);
             }
-            child._node->_parent = _node;
         }
 
-        // Set
-        void SetParent(XMLNode &parent)
+        // take this node and its subtree out of its parent, it can be
+        // inserted again anywhere
+        void Detach()
         {
-            _node->_parent = parent._node;
-            parent.AddChild(*this);
+            if (_node->_parent == nullptr || _node->_frozen)
+            {
+                return;
+            }
+            auto *top = _Top();
+            _Unlink(_node);
+            if (top->_index != nullptr)
+            {
+                top->_index->RemoveSubtree(top, _node);
+            }
         }
 
-        void SetNodeTag(std::string tag) { _node->_tag = std::move(tag); }
-
-        void SetNodeType(NodeType type) noexcept { _node->_type = type; }
+        // detach child and give its subtree back to the node pool of this
+        // thread, to be reused by the next nodes made
+        // no handle to a node of the subtree may be used after it
+        void RemoveChild(XMLNode &child)
+        {
+            assert(child._node->_parent == _node);
+            if (_node->_frozen)
+            {
+                return;
+            }
+            child.Detach();
+            _FreeTree(child._node);
+            child._node = nullptr;
+        }
 
-        void SetNodeContent(std::string context)
+        // deep copy of this node and its subtree, with no parent
+        // made in one pass from the node pool of this thread
+        [[nodiscard]] XMLNode Clone() const
         {
-            _node->_content = std::move(context);
+            return XMLNode(_CloneTree(_node));
         }
 
-        void AddNodeAttribute(const std::string &name, const std::string &value)
+        // fingerprint of the subtree, the type, tag, attributes and content
+        // of each node and the shape of the tree, equal subtrees give equal
+        // values in any process of the same byte order, so it can key a
+        // cache of results
+        // it is 64 bits and not a cryptographic hash, XMLCanonical::Digest
+        // give the SHA-256 of the canonical form
+        [[nodiscard]] uint64_t Hash() const noexcept
         {
-            _node->_attributes[name] = value;
+            uint64_t hash = _HashSeed;
+            // preorder with the depth of each node, which fix the shape
+            const XMLNodeStruct *node = _node;
+            uint64_t depth = 0;
+            while (true)
+            {
+                _Mix(hash, depth);
+                _MixFields(hash, node);
+                if (node->_firstChild != node->_lastChild)
+                {
+                    node = node->_firstChild;
+                    ++depth;
+                    continue;
+                }
+                while (node != _node
+                       && node->_next == node->_parent->_lastChild)
+                {
+                    node = node->_parent;
+                    --depth;
+                }
+                if (node == _node)
+                {
+                    return hash;
+                }
+                node = node->_next;
+            }
         }
 
-        // Get
-        [[nodiscard]] std::string GetNodeTag() const { return _node->_tag; }
+        // Set
+        void SetParent(XMLNode &parent) { parent.AddChild(*this); }
 
-        [[nodiscard]] NodeType GetNodeType() const { return _node->_type; }
+        // the namespace and local name of the old tag are dropped
+        void SetNodeTag(std::string tag)
+        {
+            if (!_node->_frozen)
+            {
+                _node->_tag = std::move(tag);
+                _node->_namespace = 0;
+                _node->_localName = 0;
+            }
+        }
 
-        [[nodiscard]] std::string GetNodeContent() const
+        void SetNodeType(NodeType type) noexcept
         {
-            return _node->_content;
+            if (!_node->_frozen)
+            {
+                _node->_type = type;
+            }
         }
 
-        [[nodiscard]] std::string
-        GetNodeAttribute(const std::string &attributeName) const
+        void SetNodeContent(std::string context)
         {
-            return _node->_attributes[attributeName];
+            if (!_node->_frozen)
+            {
+                _node->_content = std::move(context);
+            }
         }
 
-        [[nodiscard]] std::map<std::string, std::string>
-        GetNodeAttributes() const
+        void AddNodeAttribute(const std::string &name, const std::string &value)
         {
-            return _node->_attributes;
+            if (_node->_frozen)
+            {
+                return;
+            }
+            auto *top = _Top();
+            auto *index = top->_index;
+            if (index != nullptr)
+            {
+                if (auto it = _node->_attributes.find(name);
+                    it != _node->_attributes.end())
+                {
+                    index->Remove(top, _node, name, it->second);
+                }
+            }
+            _node->_attributes[name] = value;
+            if (index != nullptr)
+            {
+                index->Add(_node, name, value);
+            }
         }
 
-        [[nodiscard]] bool HasChild() const noexcept
+        void RemoveNodeAttribute(std::string_view name)
         {
-            return _node->_firstChild != _node->_lastChild;
+            auto it = _node->_attributes.find(name);
+            if (_node->_frozen || it == _node->_attributes.end())
+            {
+                return;
+            }
+            if (auto *top = _Top(); top->_index != nullptr)
+            {
+                top->_index->Remove(top, _node, it->first, it->second);
+            }
+            std::erase_if(_node->_attributeNames, [&](const auto &entry) {
+                return entry.second == &*it;
+            });
+            _node->_attributes.erase(it);
         }
 
-        // Node Accessor
-        [[nodiscard]] XMLNode GetParent() const noexcept
+        // Get
+        // getters return references into the node, nothing is copied,
+        // copy them if they must outlive the document
+        [[nodiscard]] const std::string &GetNodeTag() const noexcept
         {
-            return XMLNode(_node->_parent);
+            return _node->_tag;
         }
 
-        [[nodiscard]] XMLNode NextSibling() const
+        [[nodiscard]] NodeType GetNodeType() const { return _node->_type; }
+
+        [[nodiscard]] const std::string &GetNodeContent() const noexcept
         {
-            return _node->_next != _node->_lastChild ? _node->_next
-                                                     : XMLNode(NullNode);
+            return _node->_content;
         }
 
-        [[nodiscard]] XMLNode PrevSibling() const
+        // empty string if node don't have the attribute,
+        // the attribute map is never modified
+        [[nodiscard]] const std::string &
+        GetNodeAttribute(std::string_view attributeName) const
         {
-            return _node->_prev != _node->_lastChild ? _node->_next
-                                                     : XMLNode(NullNode);
+            auto it = _node->_attributes.find(attributeName);
+            return it != _node->_attributes.end() ? it->second : EmptyString;
         }
 
-        [[nodiscard]] XMLNodes operator[](const std::string &TagName) const
+        [[nodiscard]] bool HasNodeAttribute(std::string_view attributeName) const
         {
-            return FindChildrenByTagName(TagName);
+            return _node->_attributes.find(attributeName)
+                   != _node->_attributes.end();
         }
 
-        [[nodiscard]] XMLNode FirstChild() const
+        // namespaces are resolved only by a parse with ParseNamespaces,
+        // else and for nodes made by hand the name is {0, 0}
+        // <a:item xmlns:a="urn:a"/> has the name XMLNames::Name("urn:a",
+        // "item"), a unbound prefix resolve to no namespace
+        [[nodiscard]] XMLName GetNodeName() const noexcept
         {
-            return _node->_firstChild != _node->_lastChild ? _node->_firstChild
-                                                           : XMLNode(NullNode);
+            return {_node->_namespace, _node->_localName};
         }
 
-        [[nodiscard]] XMLNode LastChild() const
+        [[nodiscard]] std::string_view GetNamespaceURI() const
         {
-            return _node->_firstChild != _node->_lastChild
-                   ? _node->_lastChild->_prev
-                   : XMLNode(NullNode);
+            return XMLNames::NamespaceURI(_node->_namespace);
         }
 
-        [[nodiscard]] XMLNode
-        FindFirstChildByTagName(const std::string &tagName) const
+        // by resolved name, a unprefixed attribute has no namespace
+        // attributes added after the parse have no resolved name
+        [[nodiscard]] const std::string &
+        GetNodeAttribute(const XMLName &name) const noexcept
         {
-            auto first = _node->_firstChild;
-            while (first != _node->_lastChild)
+            for (auto [attributeName, attribute] : _node->_attributeNames)
             {
-                if (first->_tag == tagName)
+                if (attributeName == name)
                 {
-                    return first;
+                    return attribute->second;
                 }
-                first = first->_next;
             }
-            return XMLNode(NodeType::NullNode);
+            return EmptyString;
         }
 
-        [[nodiscard]] XMLNodes
-        FindChildrenByTagName(const std::string &tagName) const
+        // typed getters convert the stored bytes in place with from_chars,
+        // nothing is allocated and no exception is thrown, the result is
+        // empty if the text isn't a whole T (blanks around it are allowed)
+        // or the attribute is missing
+        template<typename T>
+        [[nodiscard]] std::optional<T> As() const noexcept
         {
-            XMLNodes children;
-            auto first = _node->_firstChild;
-            while (first != _node->_lastChild)
+            T value;
+            if (FromText(_node->_content, value))
             {
-                if (first->_tag == tagName)
-                {
-                    children.push_back(first);
-                }
-                first = first->_next;
+                return value;
             }
-            return children;
+            return std::nullopt;
         }
 
-        [[nodiscard]] XMLNode FindFirstChildByType(NodeType type) const
+        [[nodiscard]] std::optional<int> AsInt() const noexcept
         {
-            auto first = _node->_firstChild;
-            while (first != _node->_lastChild)
-            {
-                if (first->_type == type)
-                {
-                    return first;
-                }
-                first = first->_next;
-            }
-            return XMLNode(NodeType::NullNode);
+            return As<int>();
         }
 
-        [[nodiscard]] XMLNodes FindChildrenByType(NodeType type) const
+        [[nodiscard]] std::optional<long long> AsInt64() const noexcept
         {
-            XMLNodes children;
-            auto first = _node->_firstChild;
-            while (first != _node->_lastChild)
-            {
-                if (first->_type == type)
-                {
-                    children.push_back(first);
-                }
-                first = first->_next;
-            }
-            return children;
+            return As<long long>();
         }
 
-        [[nodiscard]] std::string StringValue() const
+        [[nodiscard]] std::optional<double> AsDouble() const noexcept
         {
-            return _node->_content;
+            return As<double>();
         }
 
-    protected:
-        struct XMLNodeStruct
+        [[nodiscard]] std::optional<bool> AsBool() const noexcept
         {
-            XMLNodeStruct() = default;
+            return As<bool>();
+        }
 
-            XMLNodeStruct(
-                std::string tag, std::string content, NodeType type,
-                XMLNodeStruct* parent = nullptr) :
-                _tag(std::move(tag)),
-                _content(std::move(content)), _type(type), _parent(parent),
-                _prev(), _next(nullptr),
-                _firstChild(memPool.New())
+        template<typename T>
+        [[nodiscard]] std::optional<T>
+        AttributeAs(std::string_view attributeName) const noexcept
+        {
+            auto it = _node->_attributes.find(attributeName);
+            T value;
+            if (it != _node->_attributes.end() && FromText(it->second, value))
             {
-                _lastChild = _firstChild;
-                _lastChild->_type = NullNode;
+                return value;
             }
+            return std::nullopt;
+        }
+
+        // convert text to a arithmetic T, bool is true, false, 1 or 0
+        // value is unspecified when return false
+        template<typename T>
+        static bool FromText(std::string_view text, T &value) noexcept
+        {
+            static_assert(std::is_arithmetic_v<T>,
+                          "only bool and arithmetic types convert from text");
+            constexpr std::string_view blank = "\x20\x09\x0d\x0A";
+            auto first = text.find_first_not_of(blank);
+            if (first == std::string_view::npos)
+            {
+                return false;
+            }
+            text = text.substr(first, text.find_last_not_of(blank) - first + 1);
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                value = text == "true" || text == "1";
+                return value || text == "false" || text == "0";
+            }
+            else
+            {
+                auto [end, error] = std::from_chars(
+                    text.data(), text.data() + text.size(), value);
+                return error == std::errc() && end == text.data() + text.size();
+            }
+        }
+
+        [[nodiscard]] const Attributes &GetNodeAttributes() const noexcept
+        {
+            return _node->_attributes;
+        }
+
+        [[nodiscard]] bool HasChild() const noexcept
+        {
+            return _node->_firstChild != _node->_lastChild;
+        }
+
+        // see XMLDocument::Freeze
+        [[nodiscard]] bool IsFrozen() const noexcept { return _node->_frozen; }
+
+        // Node Accessor
+        [[nodiscard]] XMLNode GetParent() const noexcept
+        {
+            return XMLNode(_node->_parent);
+        }
+
+        // the last child is followed by the sentinel of its parent,
+        // the first one has no prev
+        [[nodiscard]] XMLNode NextSibling() const
+        {
+            return _node->_parent != nullptr
+                           && _node->_next != _node->_parent->_lastChild
+                       ? _node->_next
+                       : _Null();
+        }
+
+        [[nodiscard]] XMLNode PrevSibling() const
+        {
+            return _node->_prev != nullptr ? _node->_prev : _Null();
+        }
+
+        [[nodiscard]] XMLNodes operator[](std::string_view TagName) const
+        {
+            return FindChildrenByTagName(TagName);
+        }
+
+        [[nodiscard]] XMLNode FirstChild() const
+        {
+            return _node->_firstChild != _node->_lastChild ? _node->_firstChild
+                                                           : _Null();
+        }
+
+        [[nodiscard]] XMLNode LastChild() const
+        {
+            return _node->_firstChild != _node->_lastChild
+                   ? _node->_lastChild->_prev
+                   : _Null();
+        }
+
+        [[nodiscard]] XMLNode
+        FindFirstChildByTagName(std::string_view tagName) const
+        {
+            auto children = Children(tagName);
+            auto first = children.begin();
+            return first != children.end() ? *first
+                                           : _Null();
+        }
+
+        [[nodiscard]] XMLNodes
+        FindChildrenByTagName(std::string_view tagName) const
+        {
+            XMLNodes children;
+            for (auto child : Children(tagName))
+            {
+                children.push_back(child);
+            }
+            return children;
+        }
+
+        // by resolved name, see GetNodeName
+        [[nodiscard]] XMLNode FindFirstChildByName(const XMLName &name) const
+        {
+            auto children = Children(name);
+            auto first = children.begin();
+            return first != children.end() ? *first
+                                           : _Null();
+        }
+
+        [[nodiscard]] XMLNodes FindChildrenByName(const XMLName &name) const
+        {
+            XMLNodes children;
+            for (auto child : Children(name))
+            {
+                children.push_back(child);
+            }
+            return children;
+        }
+
+        [[nodiscard]] XMLNode FindFirstChildByType(NodeType type) const
+        {
+            auto children = ChildrenOfType(type);
+            auto first = children.begin();
+            return first != children.end() ? *first
+                                           : _Null();
+        }
+
+        [[nodiscard]] XMLNodes FindChildrenByType(NodeType type) const
+        {
+            XMLNodes children;
+            for (auto child : ChildrenOfType(type))
+            {
+                children.push_back(child);
+            }
+            return children;
+        }
+
+        // allocation free walks, prefer them to the Find* which build vector
+        // for (auto item : root.Children("item"))
+        // root.Descendants() | std::views::filter(...)
+        [[nodiscard]] Range<ChildWalk<AnyMatch>> Children() const noexcept
+        {
+            return Range<ChildWalk<AnyMatch>>({_node, AnyMatch()});
+        }
+
+        // tag must outlive the range
+        [[nodiscard]] Range<ChildWalk<TagMatch>>
+        Children(std::string_view tag) const noexcept
+        {
+            return Range<ChildWalk<TagMatch>>({_node, TagMatch {tag}});
+        }
+
+        // compare two integers per child, no string
+        [[nodiscard]] Range<ChildWalk<NameMatch>>
+        Children(const XMLName &name) const noexcept
+        {
+            return Range<ChildWalk<NameMatch>>({_node, NameMatch {name}});
+        }
+
+        [[nodiscard]] Range<ChildWalk<TypeMatch>>
+        ChildrenOfType(NodeType type) const noexcept
+        {
+            return Range<ChildWalk<TypeMatch>>({_node, TypeMatch {type}});
+        }
+
+        // preorder, node itself is not included
+        [[nodiscard]] Range<DescendantWalk> Descendants() const noexcept
+        {
+            return Range<DescendantWalk>({_node});
+        }
+
+        // from parent to the document node
+        [[nodiscard]] Range<AncestorWalk> Ancestors() const noexcept
+        {
+            return Range<AncestorWalk>({_node});
+        }
+
+        [[nodiscard]] const std::string &StringValue() const noexcept
+        {
+            return _node->_content;
+        }
+
+    protected:
+        struct XMLNodeStruct
+        {
+            XMLNodeStruct() = default;
+
+            XMLNodeStruct(
+                std::string tag, std::string content, NodeType type,
+                XMLNodeStruct* parent = nullptr) :
+                _tag(std::move(tag)),
+                _content(std::move(content)), _type(type), _parent(parent),
+                _prev(), _next(nullptr),
+                _firstChild(_Pool().New())
+            {
+                _lastChild = _firstChild;
+                _lastChild->_type = NullNode;
+            }
+
+            // smart pointer rule to prevent circular reference
+            // parent to child : shared_ptr
+            // child to parent : weak_ptr
+            // next : shared_ptr
+            // prev : weak_ptr
+
+            // not circular list
+            Attributes _attributes;
+            std::string _tag, _content;
+            NodeType _type;
+            // set by XMLDocument::Freeze, the node is then never written
+            bool _frozen = false;
+            // ids of XMLNames, set by the parser with ParseNamespaces
+            uint32_t _namespace = 0;
+            uint32_t _localName = 0;
+            // the resolved name of each attribute, with ParseNamespaces
+            std::vector<std::pair<XMLName, const Attributes::value_type *>>
+                _attributeNames;
+            XMLNodeStruct *_parent;
+            XMLNodeStruct *_firstChild;
+            XMLNodeStruct *_lastChild;
+            XMLNodeStruct *_prev;
+            XMLNodeStruct *_next;
+            // only set on a document node which has an attribute index
+            AttributeIndex *_index = nullptr;
+        };
+
+        // document level hash index from the value of configured attributes
+        // (id, key, ...) to the element, owned by XMLDocument and reachable
+        // from the document node, the first element wins on repeated values
+        // and the next one in document order takes its place when it goes
+        struct AttributeIndex
+        {
+            struct Hash
+            {
+                using is_transparent = void;
+
+                size_t operator()(std::string_view str) const noexcept
+                {
+                    return std::hash<std::string_view>()(str);
+                }
+            };
+
+            using Table = std::unordered_map<std::string, XMLNodeStruct *,
+                                             Hash, std::equal_to<>>;
+
+            using Values =
+                std::unordered_set<std::string, Hash, std::equal_to<>>;
+
+            explicit AttributeIndex(const std::vector<std::string> &names)
+            {
+                for (const auto &name : names)
+                {
+                    tables.emplace_back(name, Table());
+                }
+                repeated.resize(tables.size());
+            }
+
+            Table *Find(std::string_view name) noexcept
+            {
+                auto slot = _Slot(name);
+                return slot < tables.size() ? &tables[slot].second : nullptr;
+            }
+
+            void Add(XMLNodeStruct *node, std::string_view name,
+                     const std::string &value)
+            {
+                if (auto slot = _Slot(name); slot < tables.size())
+                {
+                    _Add(slot, node, value);
+                }
+            }
+
+            // top is the document node, searched for another element with
+            // the value when node was the indexed one
+            void Remove(XMLNodeStruct *top, XMLNodeStruct *node,
+                        std::string_view name, std::string_view value)
+            {
+                auto slot = _Slot(name);
+                if (slot >= tables.size())
+                {
+                    return;
+                }
+                auto &table = tables[slot].second;
+                auto it = table.find(value);
+                if (it == table.end() || it->second != node)
+                {
+                    return;
+                }
+                auto repeat = repeated[slot].find(value);
+                if (repeat == repeated[slot].end())
+                {
+                    table.erase(it);
+                    return;
+                }
+                // only repeated values pay for a walk of the document
+                XMLNodeStruct *first = nullptr;
+                auto others = 0;
+                for (auto *other = top; other != nullptr && others < 2;
+                     other = _NextPreorder(other, top))
+                {
+                    if (auto attribute = other->_attributes.find(name);
+                        other != node && attribute != other->_attributes.end()
+                        && attribute->second == value)
+                    {
+                        if (first == nullptr)
+                        {
+                            first = other;
+                        }
+                        ++others;
+                    }
+                }
+                if (others < 2)
+                {
+                    repeated[slot].erase(repeat);
+                }
+                if (first == nullptr)
+                {
+                    table.erase(it);
+                }
+                else
+                {
+                    it->second = first;
+                }
+            }
+
+            void AddElement(XMLNodeStruct *node)
+            {
+                for (size_t slot = 0; slot < tables.size(); ++slot)
+                {
+                    if (auto it = node->_attributes.find(tables[slot].first);
+                        it != node->_attributes.end())
+                    {
+                        _Add(slot, node, it->second);
+                    }
+                }
+            }
+
+            // root must be out of the document of top already
+            void RemoveSubtree(XMLNodeStruct *top, XMLNodeStruct *root)
+            {
+                for (auto *node = root; node != nullptr;
+                     node = _NextPreorder(node, root))
+                {
+                    for (auto &[tableName, table] : tables)
+                    {
+                        if (auto it = node->_attributes.find(tableName);
+                            it != node->_attributes.end())
+                        {
+                            Remove(top, node, tableName, it->second);
+                        }
+                    }
+                }
+            }
+
+            void AddSubtree(XMLNodeStruct *root)
+            {
+                for (auto *node = root; node != nullptr;
+                     node = _NextPreorder(node, root))
+                {
+                    if (node->_type == NodeElement)
+                    {
+                        AddElement(node);
+                    }
+                }
+            }
+
+            void Clear() noexcept
+            {
+                for (auto &[tableName, table] : tables)
+                {
+                    table.clear();
+                }
+                for (auto &values : repeated)
+                {
+                    values.clear();
+                }
+            }
+
+            std::vector<std::pair<std::string, Table>> tables;
+
+            // values held by more than one element, per table
+            std::vector<Values> repeated;
+
+        private:
+            size_t _Slot(std::string_view name) const noexcept
+            {
+                size_t slot = 0;
+                while (slot < tables.size() && tables[slot].first != name)
+                {
+                    ++slot;
+                }
+                return slot;
+            }
+
+            void _Add(size_t slot, XMLNodeStruct *node,
+                      const std::string &value)
+            {
+                auto [it, inserted] = tables[slot].second.emplace(value, node);
+                if (!inserted && it->second != node)
+                {
+                    repeated[slot].insert(value);
+                }
+            }
+        };
+
+        // each thread allocate nodes from its own pool, so documents can be
+        // built on several threads at once
+        // pools live until exit, a node may outlive the thread which made
+        // it, the pool of a finished thread is handed to the next one
+        class NodePools
+        {
+        public:
+            using Pool = MemoryPool<XMLNodeStruct>;
+
+            static Pool &Local()
+            {
+                thread_local Lease lease;
+                return *lease.pool;
+            }
+
+            // for pools of threads started later, and the current one
+            static void SetPolicy(unsigned policy) noexcept
+            {
+                _Instance()._policy = policy;
+                Local().SetBlockPolicy(policy);
+            }
+
+        private:
+            struct Lease
+            {
+                Lease() : pool(_Instance()._Acquire()) {}
+
+                ~Lease() { _Instance()._Release(pool); }
+
+                Pool *pool;
+            };
+
+            std::mutex _mutex;
+
+            std::vector<std::unique_ptr<Pool>> _pools;
+
+            std::vector<Pool *> _free;
+
+            std::atomic<unsigned> _policy {MemoryPoolPolicy::PoolDefault};
+
+            static NodePools &_Instance()
+            {
+                static NodePools pools;
+                return pools;
+            }
+
+            Pool *_Acquire()
+            {
+                std::lock_guard lock(_mutex);
+                if (!_free.empty())
+                {
+                    auto *pool = _free.back();
+                    _free.pop_back();
+                    pool->SetBlockPolicy(_policy);
+                    return pool;
+                }
+                return _pools.emplace_back(std::make_unique<Pool>(_policy))
+                    .get();
+            }
+
+            void _Release(Pool *pool)
+            {
+                std::lock_guard lock(_mutex);
+                _free.push_back(pool);
+            }
+        };
+
+        static NodePools::Pool &_Pool() { return NodePools::Local(); }
+
+        // returned by reference for a missing attribute
+        inline static const std::string EmptyString;
+
+        // returned when nothing is found, shared and frozen so a getter
+        // never allocate or write
+        static XMLNode _Null()
+        {
+            static XMLNodeStruct *null = []() {
+                auto *node = _Pool().New("", "", NullNode);
+                node->_frozen = true;
+                return node;
+            }();
+            return XMLNode(null);
+        }
+
+        XMLNodeStruct *_node;
+
+        // the word mixing of Hash(), shared with XMLDiff
+        static constexpr uint64_t _HashSeed = 0xcbf29ce484222325ULL;
+
+        static void _Mix(uint64_t &hash, uint64_t word) noexcept
+        {
+            hash = (hash ^ word) * 0x100000001b3ULL;
+            hash ^= hash >> 29;
+        }
+
+        // length first, so fields can't run into each other
+        static void _MixBytes(uint64_t &hash, std::string_view bytes) noexcept
+        {
+            _Mix(hash, bytes.size());
+            size_t i = 0;
+            for (; i + 8 <= bytes.size(); i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes.data() + i, 8);
+                _Mix(hash, word);
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+            _Mix(hash, tail);
+        }
+
+        // type, tag, attributes and content of node, not its children
+        static void _MixFields(uint64_t &hash,
+                               const XMLNodeStruct *node) noexcept
+        {
+            _Mix(hash, node->_type);
+            _MixBytes(hash, node->_tag);
+            _Mix(hash, node->_attributes.size());
+            for (auto &[name, value] : node->_attributes)
+            {
+                _MixBytes(hash, name);
+                _MixBytes(hash, value);
+            }
+            _MixBytes(hash, node->_content);
+        }
+
+        // link child to the end of children, without any index update
+        void _LinkChild(XMLNodeStruct *child) noexcept
+        {
+            _LinkBefore(child, _node->_lastChild);
+        }
+
+        // next is a child or the sentinel, prev of the first child and of
+        // the sentinel of no children is nullptr
+        void _LinkBefore(XMLNodeStruct *child, XMLNodeStruct *next) noexcept
+        {
+            child->_prev = next->_prev;
+            child->_next = next;
+            if (next->_prev == nullptr)
+            {
+                _node->_firstChild = child;
+            }
+            else
+            {
+                next->_prev->_next = child;
+            }
+            next->_prev = child;
+            child->_parent = _node;
+        }
 
-            // smart pointer rule to prevent circular reference
-            // parent to child : shared_ptr
-            // child to parent : weak_ptr
-            // next : shared_ptr
-            // prev : weak_ptr
+        // take node out of the children of its parent, without any index
+        // update, the subtree stay under node
+        static void _Unlink(XMLNodeStruct *node) noexcept
+        {
+            if (node->_prev == nullptr)
+            {
+                node->_parent->_firstChild = node->_next;
+            }
+            else
+            {
+                node->_prev->_next = node->_next;
+            }
+            node->_next->_prev = node->_prev;
+            node->_parent = nullptr;
+            node->_prev = nullptr;
+            node->_next = nullptr;
+        }
 
-            // not circular list
-            std::map<std::string, std::string> _attributes;
-            std::string _tag, _content;
-            NodeType _type;
-            XMLNodeStruct *_parent;
-            XMLNodeStruct *_firstChild;
-            XMLNodeStruct *_lastChild;
-            XMLNodeStruct *_prev;
-            XMLNodeStruct *_next;
-        };
+        void _Insert(XMLNode &child, XMLNodeStruct *next)
+        {
+            if (_node->_frozen || child._node->_frozen)
+            {
+                return;
+            }
+#ifndef NDEBUG
+            // a node can't go under itself
+            for (auto *node = _node; node != nullptr; node = node->_parent)
+            {
+                assert(node != child._node);
+            }
+#endif
+            child.Detach();
+            _LinkBefore(child._node, next);
+            // keep the document attribute index consistent
+            if (auto *index = _FindIndex(); index != nullptr)
+            {
+                index->AddSubtree(child._node);
+            }
+        }
+
+        // give root, its subtree and their sentinels back to the pool of
+        // this thread, children are unlinked while going down so no stack
+        // is needed
+        static void _FreeTree(XMLNodeStruct *root) noexcept
+        {
+            auto &pool = _Pool();
+            auto *node = root;
+            while (true)
+            {
+                if (node->_firstChild != node->_lastChild)
+                {
+                    auto *child = node->_firstChild;
+                    node->_firstChild = child->_next;
+                    node = child;
+                    continue;
+                }
+                auto *parent = node->_parent;
+                pool.Delete(node->_lastChild);
+                bool isRoot = node == root;
+                pool.Delete(node);
+                if (isRoot)
+                {
+                    return;
+                }
+                node = parent;
+            }
+        }
+
+        // copy root and its subtree, the walk follow the source links and
+        // the copy of the current node, so no stack is needed
+        static XMLNodeStruct *_CloneTree(const XMLNodeStruct *root)
+        {
+            auto &pool = _Pool();
+            auto copyOf = [&pool](const XMLNodeStruct *node) {
+                auto *copy = pool.New(node->_tag, node->_content, node->_type);
+                copy->_attributes = node->_attributes;
+                copy->_namespace = node->_namespace;
+                copy->_localName = node->_localName;
+                for (auto [name, attribute] : node->_attributeNames)
+                {
+                    copy->_attributeNames.emplace_back(
+                        name, &*copy->_attributes.find(attribute->first));
+                }
+                return copy;
+            };
+            auto *rootCopy = copyOf(root);
+            auto *source = root;
+            auto *target = rootCopy;
+            while (true)
+            {
+                if (source->_firstChild != source->_lastChild)
+                {
+                    source = source->_firstChild;
+                    auto *copy = copyOf(source);
+                    XMLNode(target)._LinkChild(copy);
+                    target = copy;
+                    continue;
+                }
+                while (source != root
+                       && source->_next == source->_parent->_lastChild)
+                {
+                    source = source->_parent;
+                    target = target->_parent;
+                }
+                if (source == root)
+                {
+                    return rootCopy;
+                }
+                source = source->_next;
+                auto *copy = copyOf(source);
+                XMLNode(target->_parent)._LinkChild(copy);
+                target = copy;
+            }
+        }
 
-        inline static MemoryPool<XMLNodeStruct> memPool;
+        // next node of a preorder walk in the subtree of root, nullptr at the
+        // end, the parent links make an explicit stack unnecessary
+        static XMLNodeStruct *_NextPreorder(XMLNodeStruct *node,
+                                            const XMLNodeStruct *root) noexcept
+        {
+            if (node->_firstChild != node->_lastChild)
+            {
+                return node->_firstChild;
+            }
+            while (node != root)
+            {
+                if (node->_next != node->_parent->_lastChild)
+                {
+                    return node->_next;
+                }
+                node = node->_parent;
+            }
+            return nullptr;
+        }
 
-        XMLNodeStruct *_node;
+        // topmost ancestor, the document node when the node is in one
+        XMLNodeStruct *_Top() const noexcept
+        {
+            auto *node = _node;
+            while (node->_parent != nullptr)
+            {
+                node = node->_parent;
+            }
+            return node;
+        }
+
+        // index of the document which node belongs to, nullptr if none
+        AttributeIndex *_FindIndex() const noexcept
+        {
+            return _Top()->_index;
+        }
     };
 
     class XMLNodeIterator
     {
     public:
-        XMLNodeIterator() = default;
+        // no node is made, a iterator over a frozen tree never allocate
+        XMLNodeIterator() : _root(nullptr) {}
 
-        XMLNodeIterator(const XMLNode &node) { _root = node; }
+        XMLNodeIterator(const XMLNode &node) : _root(node) {}
 
         bool operator==(const XMLNodeIterator &other) const
         {
@@ -348,7 +1450,14 @@ namespace Craft
             CDATASyntaxError,
             PISyntaxError,
             PrologSyntaxError,
-            CharReferenceError
+            CharReferenceError,
+            EntityExpansionError,
+            EncodingError,
+            DepthLimitError,
+            // a value bound by XMLBinder doesn't fit its field
+            ValueConversionError,
+            // the root element bound by XMLBinder isn't the tag of its schema
+            RootMismatchError
         };
 
         // these flag are used to whether node is added to dom tree
@@ -367,9 +1476,10 @@ namespace Craft
 
         static constexpr unsigned ParseDoctype = 1 << 5;
 
-        // default save all blank in any condition
-        // if Element Content consist of blank, then merge
-        // <data>  \r \n<data>  GetNodeContent() == ""
+        // blanks before a text are dropped by default, so blanks between
+        // elements make no node, see ParsePreserveBlank and ParseTrimBlank
+        // if Element Content consist of blank, then merge, no node is made
+        // <data>  \r \n<data>  FirstChild().IsEmpty()
         static constexpr unsigned ParseMergeBlank = 1 << 6;
 
         // set it, if a parent node have child Data Node
@@ -381,6 +1491,34 @@ namespace Craft
         // dataNode.FirstChild().GetNodeContent() == "content
         static constexpr unsigned ParseDataNodeToParent = 1 << 7;
 
+        // input detected as UTF-8 must be well formed, else EncodingError
+        // UTF-16 is always checked while it is transcoded
+        static constexpr unsigned ParseValidateUTF8 = 1 << 8;
+
+        // don't stop at the first error, record it in Diagnostics() and go on
+        // from the next '<', a mismatched end tag close up to the element
+        // it match, or is dropped if none is open
+        // Status() and ErrorIndex() are then those of the first error
+        static constexpr unsigned ParseRecover = 1 << 9;
+
+        // resolve xmlns declarations while building the tree and give each
+        // element and attribute a XMLName, see XMLNode::GetNodeName
+        static constexpr unsigned ParseNamespaces = 1 << 10;
+
+        // keep text inside the root element as it is, blanks between
+        // elements included
+        static constexpr unsigned ParsePreserveBlank = 1 << 11;
+
+        // drop the blanks after a text too, a text of blanks make no node
+        // even with ParsePreserveBlank
+        static constexpr unsigned ParseTrimBlank = 1 << 12;
+
+        // store a text once, in the content of its element, instead of a
+        // data node, <price>9</price> has no child and its content is "9"
+        // a text followed by a sibling still get a data node, to keep the
+        // order of mixed content
+        static constexpr unsigned ParseTextInParent = 1 << 13;
+
         static constexpr unsigned ParseFull =
             ParseDeclaration | ParseComment | ParsePI | ParseCData
             | ParseEscapeChar | ParseDoctype | ParseDataNodeToParent;
@@ -390,138 +1528,585 @@ namespace Craft
         XMLNode ParseFile(const std::string &fileName,
                           unsigned parseFlag = ParseFull)
         {
-            std::ifstream file(fileName, std::ios::in);
+            // binary, UTF-16 input must not be touched by text mode
+            std::ifstream file(fileName, std::ios::in | std::ios::binary);
             if (!file.is_open())
             {
                 _status = FileOpenFailed;
+                _errorIndex = -1;
+                _source = {};
                 return XMLNode(XMLNode::NodeType::NullNode);
             }
-            std::string contents((std::istreambuf_iterator<char>(file)),
-                                 std::istreambuf_iterator<char>());
-            std::string_view view = contents;
+            // kept until the next parse if a error is located in it
+            _file.assign(std::istreambuf_iterator<char>(file),
+                         std::istreambuf_iterator<char>());
             _parseFlag = parseFlag;
-            return _Parse(view);
+            auto root = _Build(_file);
+            if (_status == NoError && _diagnostics.empty())
+            {
+                // the tree don't need the text, don't hold a second copy of
+                // the file for the life of the document
+                _source = {};
+                std::string().swap(_file);
+                std::string().swap(_decoded);
+            }
+            return root;
         }
 
         XMLNode ParseString(std::string_view XMLString,
                             unsigned parseFlag = ParseFull)
         {
             _parseFlag = parseFlag;
-            return _Parse(XMLString);
+            return _Build(XMLString);
+        }
+
+        // parse flag known at compile time, every flag test of the parser
+        // is then a constant, e.g. ParseString<XMLParser::ParseMinimal>(str)
+        // ParseString(str, flag) only have specialized parsers for
+        // ParseFull and ParseMinimal, other flags are tested at run time
+        template<unsigned Flags>
+        XMLNode ParseString(std::string_view XMLString)
+        {
+            static_assert(Flags != RuntimeFlags);
+            _parseFlag = Flags;
+            return _Build<Flags>(XMLString);
+        }
+
+        // run the same checks as ParseString without building the tree,
+        // Status() and ErrorIndex() are the same a full parse would give
+        // nothing is allocated unless the input has to be transcoded, it
+        // declare entities or it nest deeper than the inline tag stack
+        ParseStatus Validate(std::string_view XMLString,
+                             unsigned parseFlag = ParseFull)
+        {
+            _parseFlag = parseFlag;
+            Validator validator;
+            _Parse(XMLString, validator);
+            return _status;
         }
 
+        // one error of a ParseRecover parse
+        struct Diagnostic
+        {
+            ParseStatus status;
+            int errorIndex;
+        };
+
         ParseStatus Status() { return _status; }
 
         int ErrorIndex() { return _errorIndex; }
 
+        // errors of the last parse in input order, empty without
+        // ParseRecover, XMLParserResult(status, errorIndex, input) locate one
+        [[nodiscard]] const std::vector<Diagnostic> &Diagnostics() const
+        {
+            return _diagnostics;
+        }
+
         // [66]CharRef ::= '&#' [0-9]+ ';'
         //              | '&#x' [0-9a-fA-F]+ ';'
         // [67]Reference ::= EntityRef | CharRef
         // [68]EntityRef ::= '&' Name ';'
         // [69]PEReference ::= '%' Name ';'
-        char ParseCharReference(std::string_view contents, size_t &i)
+        // i point to the char after '&', append the replacement text to out
+        // in UTF-8 and move i after ';'
+        // return false and keep i if it is not a char reference, predefined
+        // entity or entity declared in DOCTYPE, caller treat it as plain text
+        // a bad char reference or too much expansion also set Status()
+        bool ParseCharReference(std::string_view contents, size_t &i,
+                                std::string &out)
         {
-            char c = '\0';
-            switch (contents[i])
+            return _ParseReference(contents, i, out, 0);
+        }
+
+        // open elements allowed at once, 0 is unlimited
+        // deeper document fail with DepthLimitError as soon as it get there
+        void SetMaxDepth(size_t depth) noexcept { _maxDepth = depth; }
+
+        // total bytes entity references may expand to in one document,
+        // guard against "billion laughs" documents
+        void SetEntityExpansionLimit(size_t limit) noexcept
+        {
+            _entityExpansionLimit = limit;
+        }
+
+    private:
+        friend class XMLDocument;
+        friend class XMLReader;
+
+        constexpr static std::string_view SymbolNotUsedInName =
+            R"(!"#$%&'()*+,/;<=>?@[\]^`{|}~ )";
+        // constexpr static std::string_view Blank = "\t\r\n ";
+        constexpr static std::string_view Blank = "\x20\x09\x0d\x0A";
+
+        ParseStatus _status = NoError;
+
+        int _errorIndex = -1;
+
+        unsigned _parseFlag = ParseFull;
+
+        // Flags of a parse production is a parse flag known at compile time,
+        // or this one to read _parseFlag
+        static constexpr unsigned RuntimeFlags = ~0u;
+
+        template<unsigned Flags>
+        [[nodiscard]] bool _Has(unsigned flag) const noexcept
+        {
+            if constexpr (Flags == RuntimeFlags)
+            {
+                return (_parseFlag & flag) != 0;
+            }
+            else
+            {
+                return (Flags & flag) != 0;
+            }
+        }
+
+        static constexpr unsigned MaxEntityDepth = 16;
+
+        // entities declared in the internal subset of DOCTYPE
+        std::unordered_map<std::string, std::string,
+                           XMLNode::AttributeIndex::Hash, std::equal_to<>>
+            _entities;
+
+        size_t _entityExpansion = 0;
+
+        size_t _entityExpansionLimit = 1 << 20;
+
+        // open elements of current parse
+        size_t _depth = 0;
+
+        size_t _maxDepth = 0;
+
+        std::vector<Diagnostic> _diagnostics;
+
+        // input transcoded to UTF-8, kept to reuse its capacity
+        std::string _decoded;
+
+        // contents of the last ParseFile which had a error
+        std::string _file;
+
+        // text ErrorIndex() is a offset of, the input or _decoded
+        std::string_view _source;
+
+        // set by XMLDocument when it index some attributes
+        XMLNode::AttributeIndex *_index = nullptr;
+
+        // sink of decoded text when nothing is kept
+        struct NullText
+        {
+            void push_back(char) noexcept {}
+
+            void append(std::string_view) noexcept {}
+
+            void append(const char *, size_t) noexcept {}
+        };
+
+        // first N elements are stored inline, only a deeper use allocate
+        template<typename T, size_t N>
+        class InlineStack
+        {
+        public:
+            void Push(T value)
             {
-                case 'l':
+                if (_size < N)
                 {
-                    if (contents[i + 1] != 't')
-                    {
-                        return '\0';
-                    }
-                    c = '<';
-                    i += 2;
-                    break;
+                    _inline[_size] = value;
+                }
+                else
+                {
+                    _spill.push_back(value);
+                }
+                ++_size;
+            }
+
+            void Pop() noexcept
+            {
+                --_size;
+                if (_size >= N)
+                {
+                    _spill.pop_back();
+                }
+            }
+
+            const T &operator[](size_t k) const noexcept
+            {
+                return k < N ? _inline[k] : _spill[k - N];
+            }
+
+            [[nodiscard]] const T &Back() const noexcept
+            {
+                return (*this)[_size - 1];
+            }
+
+            [[nodiscard]] size_t Size() const noexcept { return _size; }
+
+            void Clear() noexcept
+            {
+                _size = 0;
+                _spill.clear();
+            }
+
+        private:
+            T _inline[N] {};
+            std::vector<T> _spill;
+            size_t _size = 0;
+        };
+
+        // the productions below only check the grammar, what is built from
+        // it is up to a handler:
+        //   Text                    decoded attribute value and char data
+        //   StartElement(tag)       a start tag, attributes follow
+        //   StartDeclaration()      <?xml, attributes follow
+        //   Attribute(name, value)  false if name is repeated
+        //   EndDeclaration(keep)
+        //   EmptyElement()          end of <tag/>
+        //   OpenElement()           end of <tag>
+        //   IsOpen(tag)             tag of the innermost open element
+        //   Enclosing(tag, depth)   how many open elements to close to close
+        //                           tag, 0 if it is not open
+        //   CloseElement()
+        //   Data Comment CData PI Doctype
+
+        // build the DOM tree under a document node
+        class DOMBuilder
+        {
+        public:
+            using Text = std::string;
+
+            DOMBuilder(const XMLNode &root, XMLNode::AttributeIndex *index,
+                       bool namespaces = false, bool textInParent = false)
+                : _current(root), _index(index), _pool(XMLNode::_Pool()),
+                  _namespaces(namespaces), _textInParent(textInParent)
+            {
+            }
+
+            void StartElement(std::string_view tag)
+            {
+                // left by a element dropped on a error
+                _PopPendingBindings();
+                _pending = _pool.New(std::string(tag), "",
+                                     XMLNode::NodeType::NodeElement);
+            }
+
+            void StartDeclaration()
+            {
+                _pending =
+                    _pool.New("", "", XMLNode::NodeType::NodeDeclaration);
+            }
+
+            bool Attribute(std::string_view name, Text &&value)
+            {
+                auto &attributes = _pending->_attributes;
+                if (attributes.find(name) != attributes.end())
+                {
+                    return false;
+                }
+                if (_namespaces
+                    && _pending->_type == XMLNode::NodeType::NodeElement
+                    && (name == "xmlns" || name.starts_with("xmlns:")))
+                {
+                    auto prefix = name.size() > 5 ? name.substr(6)
+                                                  : std::string_view();
+                    _bindings.push_back(
+                        {std::string(prefix), XMLNames::Namespace(value)});
+                    ++_pendingBindings;
+                }
+                attributes.emplace(name, std::move(value));
+                return true;
+            }
+
+            void EndDeclaration(bool keep)
+            {
+                if (keep)
+                {
+                    _current._LinkChild(_pending);
+                }
+            }
+
+            void EmptyElement()
+            {
+                _AddPending();
+                _PopPendingBindings();
+            }
+
+            void OpenElement()
+            {
+                _AddPending();
+                if (_namespaces)
+                {
+                    _bindingCounts.push_back(_pendingBindings);
+                    _pendingBindings = 0;
                 }
-                case 'g':
+                _current = XMLNode(_pending);
+            }
+
+            [[nodiscard]] bool IsOpen(std::string_view tag) const
+            {
+                return _current.GetNodeTag() == tag;
+            }
+
+            [[nodiscard]] size_t Enclosing(std::string_view tag,
+                                           size_t depth) const
+            {
+                auto node = _current;
+                for (size_t n = 1; n <= depth; ++n)
                 {
-                    if (contents[i + 1] != 't')
+                    if (node.GetNodeTag() == tag)
                     {
-                        return '\0';
+                        return n;
                     }
-                    c = '>';
-                    i += 2;
-                    break;
+                    node = node.GetParent();
+                }
+                return 0;
+            }
+
+            void CloseElement()
+            {
+                if (_namespaces)
+                {
+                    _bindings.resize(_bindings.size() - _bindingCounts.back());
+                    _bindingCounts.pop_back();
+                }
+                _current = _current.GetParent();
+            }
+
+            void Data(Text &&text, bool toParent)
+            {
+                if (_textInParent && !_current.HasChild()
+                    && _current.GetNodeContent().empty())
+                {
+                    _current.SetNodeContent(std::move(text));
+                    return;
+                }
+                if (toParent && _current.GetNodeContent().empty())
+                {
+                    _current.SetNodeContent(text);
+                }
+                _Add("", std::move(text), XMLNode::NodeType::NodeData);
+            }
+
+            void Comment(std::string_view text)
+            {
+                _Add("", std::string(text), XMLNode::NodeType::NodeComment);
+            }
+
+            void CData(std::string_view text)
+            {
+                _Add("", std::string(text), XMLNode::NodeType::NodeCData);
+            }
+
+            void PI(std::string_view name, std::string_view text)
+            {
+                _Add(std::string(name), std::string(text),
+                     XMLNode::NodeType::NodePI);
+            }
+
+            void Doctype(std::string_view text)
+            {
+                _Add("", std::string(text), XMLNode::NodeType::NodeDoctype);
+            }
+
+        private:
+            XMLNode _current;
+
+            // element or declaration whose attributes are being read
+            XMLNode::XMLNodeStruct *_pending = nullptr;
+
+            XMLNode::AttributeIndex *_index;
+
+            // of this thread, looked up once per parse
+            XMLNode::NodePools::Pool &_pool;
+
+            // prefix ("" for the default namespace) to namespace id
+            struct Binding
+            {
+                std::string prefix;
+                uint32_t uri;
+            };
+
+            bool _namespaces;
+
+            bool _textInParent;
+
+            // scope stack, the innermost binding of a prefix is the last
+            std::vector<Binding> _bindings;
+
+            // bindings declared on each open element
+            std::vector<size_t> _bindingCounts;
+
+            // bindings declared on _pending
+            size_t _pendingBindings = 0;
+
+            void _PopPendingBindings()
+            {
+                _bindings.resize(_bindings.size() - _pendingBindings);
+                _pendingBindings = 0;
+            }
+
+            // with ParseTextInParent, a text kept in the content of _current
+            // get its node once a sibling follow it
+            void _KeepTextOrder()
+            {
+                if (_textInParent && !_current.HasChild()
+                    && !_current.GetNodeContent().empty())
+                {
+                    _current._LinkChild(_pool.New("", _current.GetNodeContent(),
+                                                  XMLNode::NodeType::NodeData));
+                }
+            }
+
+            void _AddPending()
+            {
+                _KeepTextOrder();
+                _current._LinkChild(_pending);
+                if (_index != nullptr)
+                {
+                    _index->AddElement(_pending);
+                }
+                if (_namespaces)
+                {
+                    _Resolve(_pending);
                 }
-                case 'a':
+            }
+
+            uint32_t _Lookup(std::string_view prefix) const
+            {
+                for (auto it = _bindings.rbegin(); it != _bindings.rend(); ++it)
                 {
-                    if (contents[i + 1] == 'm' && contents[i + 2] == 'p')
+                    if (it->prefix == prefix)
                     {
-                        c = '&';
-                        i += 3;
-                    }
-                    else if (contents[i + 1] == 'p' && contents[i + 2] == 'o'
-                             && contents[i + 3] == 's')
-                    {
-                        c = '\'';
-                        i += 4;
-                    }
-                    else
-                    {
-                        return '\0';
+                        return it->uri;
                     }
-                    break;
                 }
-                case 'q':
+                return prefix == "xml"
+                           ? XMLNames::Namespace(XMLNames::XMLNamespace)
+                           : 0;
+            }
+
+            // a unprefixed element is in the default namespace, a unprefixed
+            // attribute in none, the xmlns attributes themselves get no name
+            void _Resolve(XMLNode::XMLNodeStruct *node) const
+            {
+                std::string_view tag = node->_tag;
+                auto colon = tag.find(':');
+                if (colon == std::string_view::npos)
                 {
-                    if (contents[i + 1] == 'u' && contents[i + 2] == 'o'
-                        && contents[i + 3] == 't')
-                    {
-                        c = '"';
-                        i += 4;
-                    }
-                    break;
+                    node->_namespace = _Lookup("");
+                    node->_localName = XMLNames::Local(tag);
                 }
-                case '#':
+                else
                 {
-                    ++i;
-                    std::string num;
-                    if (contents[i] == 'x')
+                    node->_namespace = _Lookup(tag.substr(0, colon));
+                    node->_localName = XMLNames::Local(tag.substr(colon + 1));
+                }
+                for (auto &attribute : node->_attributes)
+                {
+                    std::string_view name = attribute.first;
+                    colon = name.find(':');
+                    XMLName resolved;
+                    if (colon == std::string_view::npos)
                     {
-                        ++i;
-                        num = "0x";
-                        while (_IsNumber(contents[i])
-                               || (contents[i] >= 'A' && contents[i] <= 'F'))
+                        if (name == "xmlns")
                         {
-                            ++i;
-                            num.push_back(contents[i]);
+                            continue;
                         }
-                        c = static_cast<char>(strtol(num.c_str(), nullptr, 16));
+                        resolved.localId = XMLNames::Local(name);
                     }
                     else
                     {
-                        while (_IsNumber(contents[i]))
+                        auto prefix = name.substr(0, colon);
+                        if (prefix == "xmlns")
                         {
-                            num.push_back(contents[i]);
-                            ++i;
+                            continue;
                         }
-                        c = static_cast<char>(std::stoi(num));
+                        resolved = {_Lookup(prefix),
+                                    XMLNames::Local(name.substr(colon + 1))};
                     }
-                    break;
+                    node->_attributeNames.emplace_back(resolved, &attribute);
                 }
-                default:
-                    return '\0';
             }
-            if (contents[i] != ';')
+
+            void _Add(std::string tag, std::string content,
+                      XMLNode::NodeType type)
             {
-                return '\0';
+                _KeepTextOrder();
+                _current._LinkChild(
+                    _pool.New(std::move(tag), std::move(content), type));
             }
-            ++i;
-            return c;
-        }
+        };
 
-    private:
-        constexpr static std::string_view SymbolNotUsedInName =
-            R"(!"#$%&'()*+,/;<=>?@[\]^`{|}~ )";
-        // constexpr static std::string_view Blank = "\t\r\n ";
-        constexpr static std::string_view Blank = "\x20\x09\x0d\x0A";
+        // keep only what the checks need, tags and attribute names are views
+        // into the input
+        class Validator
+        {
+        public:
+            using Text = NullText;
 
-        ParseStatus _status = NoError;
+            void StartElement(std::string_view tag)
+            {
+                _tag = tag;
+                _attributes.Clear();
+            }
 
-        int _errorIndex = -1;
+            void StartDeclaration() { _attributes.Clear(); }
 
-        unsigned _parseFlag = ParseFull;
+            bool Attribute(std::string_view name, Text &&)
+            {
+                for (size_t k = 0; k < _attributes.Size(); ++k)
+                {
+                    if (_attributes[k] == name)
+                    {
+                        return false;
+                    }
+                }
+                _attributes.Push(name);
+                return true;
+            }
+
+            void EndDeclaration(bool) {}
+
+            void EmptyElement() {}
+
+            void OpenElement() { _openTags.Push(_tag); }
+
+            [[nodiscard]] bool IsOpen(std::string_view tag) const
+            {
+                return _openTags.Back() == tag;
+            }
+
+            [[nodiscard]] size_t Enclosing(std::string_view tag,
+                                           size_t depth) const
+            {
+                for (size_t n = 1; n <= depth; ++n)
+                {
+                    if (_openTags[_openTags.Size() - n] == tag)
+                    {
+                        return n;
+                    }
+                }
+                return 0;
+            }
+
+            void CloseElement() { _openTags.Pop(); }
+
+            void Data(Text &&, bool) {}
+
+            void Comment(std::string_view) {}
+
+            void CData(std::string_view) {}
+
+            void PI(std::string_view, std::string_view) {}
+
+            void Doctype(std::string_view) {}
+
+        private:
+            std::string_view _tag;
+
+            InlineStack<std::string_view, 64> _openTags;
+
+            InlineStack<std::string_view, 16> _attributes;
+        };
 
         [[nodiscard]] bool _IsNameChar(char c) const noexcept
         {
@@ -552,20 +2137,165 @@ namespace Craft
         // [#x10000-#x10FFFF]
         /* 除了代用块（surrogate block），FFFE 和 FFFF 以外的任意 Unicode
          * 字符。*/
-        bool _IsChar(char c)
+        // c is a code point, not a byte of the input
+        [[nodiscard]] static constexpr bool _IsChar(char32_t c) noexcept
+        {
+            return c == 0x09 || c == 0x0A || c == 0x0D
+                   || (c >= 0x20 && c <= 0xD7FF)
+                   || (c >= 0xE000 && c <= 0xFFFD)
+                   || (c >= 0x10000 && c <= 0x10FFFF);
+        }
+
+        // value of a hex or decimal digit, -1 if c is not a digit
+        [[nodiscard]] static constexpr int _DigitValue(char c,
+                                                       bool hex) noexcept
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (hex && c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (hex && c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        // lt gt amp apos quot, switch on length so at most two compares
+        [[nodiscard]] static constexpr char
+        _PredefinedEntity(std::string_view name) noexcept
+        {
+            switch (name.size())
+            {
+                case 2:
+                    if (name == "lt")
+                    {
+                        return '<';
+                    }
+                    return name == "gt" ? '>' : '\0';
+                case 3:
+                    return name == "amp" ? '&' : '\0';
+                case 4:
+                    if (name == "apos")
+                    {
+                        return '\'';
+                    }
+                    return name == "quot" ? '"' : '\0';
+                default:
+                    return '\0';
+            }
+        }
+
+        // entity declared in the internal subset may refer to other entities,
+        // depth and total size of expansion are both limited
+        template<typename Text>
+        bool _ParseReference(std::string_view contents, size_t &i, Text &out,
+                             unsigned depth)
         {
-            if (c == 0x09 || c == 0x0A || c == 0x0D
-                || (c >= 0x20 && c <= 0xD7FF))
+            auto first = i;
+            if (i < contents.size() && contents[i] == '#')
+            {
+                ++i;
+                bool hex = i < contents.size() && contents[i] == 'x';
+                if (hex)
+                {
+                    ++i;
+                }
+                auto digitFirst = i;
+                char32_t c = 0;
+                int digit;
+                while (i < contents.size()
+                       && (digit = _DigitValue(contents[i], hex)) >= 0)
+                {
+                    // saturate, anything above 0x10FFFF is rejected below
+                    c = c > 0x10FFFF ? c : c * (hex ? 16 : 10) + digit;
+                    ++i;
+                }
+                if (i == digitFirst || i >= contents.size()
+                    || contents[i] != ';' || !_IsChar(c))
+                {
+                    _status = CharReferenceError;
+                    _errorIndex = i;
+                    i = first;
+                    return false;
+                }
+                ++i;
+                Encoding::AppendUTF8(c, out);
+                return true;
+            }
+
+            auto last = i;
+            while (last < contents.size() && _IsNameChar(contents[last]))
+            {
+                ++last;
+            }
+            if (last == i || last >= contents.size() || contents[last] != ';')
+            {
+                return false;
+            }
+            auto name = contents.substr(i, last - i);
+            if (auto c = _PredefinedEntity(name); c != '\0')
             {
+                out.push_back(c);
+                i = last + 1;
                 return true;
             }
-            return false;
+            auto entity = _entities.find(name);
+            if (entity == _entities.end())
+            {
+                return false;
+            }
+            _entityExpansion += entity->second.size();
+            if (depth >= MaxEntityDepth
+                || _entityExpansion > _entityExpansionLimit)
+            {
+                _status = EntityExpansionError;
+                _errorIndex = i;
+                return false;
+            }
+            i = last + 1;
+            _ExpandEntity(entity->second, out, depth + 1);
+            if (_status != NoError && depth == 0)
+            {
+                // a offset in the replacement text mean nothing to the
+                // document, point at the reference in it
+                _errorIndex = static_cast<int>(first) - 1;
+            }
+            return _status == NoError;
+        }
+
+        // replacement text is inserted as character data
+        template<typename Text>
+        void _ExpandEntity(std::string_view value, Text &out, unsigned depth)
+        {
+            size_t first = 0;
+            size_t i = 0;
+            while ((i = value.find('&', i)) != std::string_view::npos)
+            {
+                out.append(value.substr(first, i - first));
+                first = i;
+                ++i;
+                if (_ParseReference(value, i, out, depth))
+                {
+                    first = i;
+                }
+                else if (_status != NoError)
+                {
+                    return;
+                }
+            }
+            out.append(value.substr(first));
         }
 
         //[4]NameChar ::= Letter | Digit | '.' | '-' | '_' | ':' | CombiningChar
         //|
         // Extender [5]Name ::= (Letter | '_' | ':') (NameChar)*/
-        std::string _ParseName(std::string_view contents, size_t &i)
+        // view into contents, nothing is allocated
+        std::string_view _ParseName(std::string_view contents, size_t &i)
         {
             //            if(!(contents[i] == '_' || contents[i] == ':' ||
             //            _IsLetter(contents[i])))
@@ -579,11 +2309,11 @@ namespace Craft
             i = contents.find_first_of(SymbolNotUsedInName, i);
             if (i != std::string::npos)
             {
-                return std::string(contents.substr(first, i - first));
+                return contents.substr(first, i - first);
             }
             else
             {
-                return "";
+                return {};
             }
         }
 
@@ -595,11 +2325,12 @@ namespace Craft
         // VersionNum
         // '"')/* */ [25]Eq ::= S? '=' S? [26]VersionNum ::= ([a-zA-Z0-9_.:] |
         // '-')+
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseDeclaration(std::string_view contents, size_t &i,
-                               XMLNode &current)
+                               Handler &handler)
         {
-            auto newChild = XMLNode(XMLNode::NodeType::NodeDeclaration);
-            _ParseAttribute(contents, i, newChild);
+            handler.StartDeclaration();
+            _ParseAttribute<Flags>(contents, i, handler);
             if (!(contents[i] == '?' && contents[i + 1] == '>')
                 || _status != NoError)
             {
@@ -611,10 +2342,7 @@ namespace Craft
             // standard 2.9
             // about encoding
             // https://web.archive.org/web/20091015072716/http://lightning.prohosting.com/~qqiu/REC-xml-20001006-cn.html#NT-EncodingDecl
-            if (_parseFlag & ParseDeclaration)
-            {
-                current.AddChild(newChild);
-            }
+            handler.EndDeclaration(_Has<Flags>(ParseDeclaration));
         }
 
         void _ParseBlank(std::string_view contents, size_t &i)
@@ -626,49 +2354,65 @@ namespace Craft
 
         //        [10]AttValue ::= '"' ([^<&"] | Reference)* '"'
         //                    |  "'" ([^<&'] | Reference)* "'"
-        std::string _ParseAttributeValue(std::string_view contents, size_t &i)
+        template<unsigned Flags, typename Text>
+        Text _ParseAttributeValue(std::string_view contents, size_t &i)
         {
             auto firstQuotation = contents[i];
             if (firstQuotation != '"' && firstQuotation != '\'')
             {
                 _status = AttributeSyntaxError;
                 _errorIndex = i;
-                return "";
+                return {};
             }
             ++i;
 
             auto firstIndex = i;
-            std::string attributeValue;
+            Text attributeValue;
+            if (!_Has<Flags>(ParseEscapeChar))
+            {
+                // nothing to decode, the value is one run
+                i = std::min(contents.find(firstQuotation, i), contents.size());
+            }
             while (i < contents.size() && contents[i] != firstQuotation)
             {
-                if ((_parseFlag & ParseEscapeChar) && (contents[i] == '&'))
+                if (_Has<Flags>(ParseEscapeChar) && (contents[i] == '&'))
                 {
-                    auto lastIndex = i;
+                    attributeValue.append(
+                        contents.substr(firstIndex, i - firstIndex));
+                    // not a reference, '&' is kept as text
+                    firstIndex = i;
                     ++i;
-                    if (auto refChar = ParseCharReference(contents, i);
-                        refChar != '\0')
+                    if (_ParseReference(contents, i, attributeValue, 0))
                     {
-                        attributeValue += std::string(contents.substr(
-                            firstIndex, lastIndex - firstIndex));
-                        attributeValue.push_back(refChar);
                         firstIndex = i;
                     }
+                    else if (_status != NoError)
+                    {
+                        return {};
+                    }
                 }
                 else
                 {
                     ++i;
                 }
             }
-            attributeValue +=
-                std::string(contents.substr(firstIndex, i - firstIndex));
+            if (i >= contents.size())
+            {
+                // never closed, don't read past the input
+                _status = AttributeSyntaxError;
+                _errorIndex = i;
+                return {};
+            }
+            attributeValue.append(contents.substr(firstIndex, i - firstIndex));
             ++i;
             return attributeValue;
         }
 
         // [15]Comment::='<!--' ((Char - '-') | ('-' (Char - '-')))* '-->'
         // <!  incoming index is point to '!'
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseComment(std::string_view contents, size_t &i,
-                           XMLNode &current)
+                           Handler &handler)
         {
             auto commentFirst = i;
             while (i < contents.size())
@@ -688,13 +2432,10 @@ namespace Craft
                 }
                 ++i; // is char
             }
-            if (_parseFlag & ParseComment)
+            if (_Has<Flags>(ParseComment))
             {
-                auto newNode = XMLNode("",
-                                       std::string(contents.substr(
-                                           commentFirst, i - commentFirst)),
-                                       XMLNode::NodeType::NodeComment);
-                current.AddChild(newNode);
+                handler.Comment(
+                    contents.substr(commentFirst, i - commentFirst));
             }
             i += 3;
         }
@@ -706,112 +2447,135 @@ namespace Craft
 
         // 	[14]CharData	   ::=   	[^<&]* - ([^<&]* ']]>' [^<&]*)
         //	[67]Reference	   ::=   	EntityRef | CharRef
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseElementCharData(std::string_view contents, size_t &i,
-                                   XMLNode &current)
+                                   Handler &handler)
         {
             auto firstIndex = i;
-            std::string charData;
+            typename Handler::Text charData;
             bool mergeBlankFlag = true;
+            auto first = i;
+            if (!_Has<Flags>(ParseEscapeChar) && !_Has<Flags>(ParseMergeBlank))
+            {
+                // no char to look at but '<'
+                i = std::min(contents.find('<', i), contents.size());
+            }
             while (i < contents.size() && contents[i] != '<')
             {
                 // if not blank
-                if ((_parseFlag & ParseMergeBlank)
+                if (_Has<Flags>(ParseMergeBlank)
                     && !_IsBlankChar(contents[i]))
                 {
                     mergeBlankFlag = false;
                 }
-                if ((_parseFlag & ParseEscapeChar) && (contents[i] == '&'))
+                if (_Has<Flags>(ParseEscapeChar) && (contents[i] == '&'))
                 {
-                    // if return '\0', may be a entity ref, treat it as plain
-                    // text
-                    auto lastIndex = i;
+                    charData.append(
+                        contents.substr(firstIndex, i - firstIndex));
+                    // if return false, may be a undeclared entity ref,
+                    // treat it as plain text
+                    firstIndex = i;
                     ++i;
-                    if (auto refChar = ParseCharReference(contents, i);
-                        refChar != '\0')
+                    if (_ParseReference(contents, i, charData, 0))
                     {
-                        charData += std::string(contents.substr(
-                            firstIndex, lastIndex - firstIndex));
-                        charData.push_back(refChar);
                         firstIndex = i;
                     }
+                    else if (_status != NoError)
+                    {
+                        return;
+                    }
                 }
                 else
                 {
                     ++i;
                 }
             }
-            if ((_parseFlag & ParseMergeBlank) && mergeBlankFlag)
-            {
-                charData = "";
-            }
-            else
+            if (_Has<Flags>(ParseMergeBlank) && mergeBlankFlag)
             {
-                charData +=
-                    std::string(contents.substr(firstIndex, i - firstIndex));
+                return;
             }
-            auto newChild = XMLNode("", charData, XMLNode::NodeType::NodeData);
-            current.AddChild(newChild);
-            if ((_parseFlag & ParseDataNodeToParent)
-                && (current.GetNodeContent().empty()))
+            auto last = i;
+            if (_Has<Flags>(ParseTrimBlank))
             {
-                current.SetNodeContent(charData);
+                while (last > firstIndex && _IsBlankChar(contents[last - 1]))
+                {
+                    --last;
+                }
+                // only blanks, no reference was read either
+                if (last == first)
+                {
+                    return;
+                }
             }
+            charData.append(contents.substr(firstIndex, last - firstIndex));
+            handler.Data(std::move(charData),
+                         _Has<Flags>(ParseDataNodeToParent));
         }
 
         // [43]content ::= CharData? ((element | Reference | CDSect | PI |
         // Comment) CharData?)*	/* */
         //  CDSect : CDATA[21]
-        void _ParseElementContent(std::string_view contents, size_t &i,
-                                  XMLNode &current)
+        // one construct of content, a markup at '<' or a run of char data
+        // whose leading blanks are skipped unless ParsePreserveBlank
+        template<unsigned Flags = RuntimeFlags, typename Handler>
+        void _ParseNext(std::string_view contents, size_t &i, Handler &handler)
         {
-            std::string content;
-            while (i < contents.size())
+            if (contents[i] != '<')
             {
-                _ParseBlank(contents, i);
-                if (contents[i] == '<')
+                if (!_Has<Flags>(ParsePreserveBlank) || _depth == 0)
                 {
-                    if (contents[i + 1] == '!')
+                    _ParseBlank(contents, i);
+                }
+                if (i < contents.size() && contents[i] != '<')
+                {
+                    _ParseElementCharData<Flags>(contents, i, handler);
+                }
+                return;
+            }
+            ++i;
+            switch (contents[i])
+            {
+                case '?':
+                    // declaration must be first line which not null
+                    if (_IsXMLDeclarationStart(contents, i - 1))
+                    {
+                        _status = DeclarationPositionError;
+                        _errorIndex = i;
+                    }
+                    else
                     {
                         ++i;
-                        if (contents[i + 1] == '-' && contents[i + 2] == '-')
-                        {
-                            i += 3;
-                            _ParseComment(contents, i, current);
-                        }
-                        else if (contents[i + 1] == '[')
-                        {
-                            if (contents.substr(i + 1, 7) == "[CDATA[")
-                            {
-                                i += 8;
-                                _ParseCDATA(contents, i, current);
-                            }
-                        }
-                        else
-                        {
-                            break;
-                        }
+                        _ParsePI<Flags>(contents, i, handler);
                     }
-                    else if (contents[i + 1] == '?')
+                    break;
+                case '/': // end tag </tag>
+                    i += 1;
+                    _ParseEndTag<Flags>(contents, i, handler);
+                    break;
+                case '!':
+                    if (contents[i + 1] == '-' && contents[i + 2] == '-')
                     {
-                        i += 2;
-                        _ParsePI(contents, i, current);
+                        i += 3;
+                        _ParseComment<Flags>(contents, i, handler);
+                        break;
                     }
-                    else
+                    if (contents.substr(i, 8) == "![CDATA[")
                     {
-                        // parse to child element start <
+                        i += 8;
+                        _ParseCDATA<Flags>(contents, i, handler);
                         break;
                     }
-                }
-                else
-                {
-                    _ParseElementCharData(contents, i, current);
-                }
+                    // <!x is read as a tag, which report the error
+                    [[fallthrough]];
+                default: // <tag>
+                    _ParseStartTag<Flags>(contents, i, handler);
             }
         }
 
         // [41]Attribute ::= Name Eq AttValue
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseAttribute(std::string_view contents, size_t &i,
-                             XMLNode &newNode)
+                             Handler &handler)
         {
             while (_IsBlankChar(contents[i]))
             {
@@ -847,27 +2611,29 @@ namespace Craft
                 _ParseBlank(contents, i);
                 // Attribute Value
                 // can't use '&'
-                auto attributeValue = _ParseAttributeValue(contents, i);
+                auto attributeValue =
+                    _ParseAttributeValue<Flags, typename Handler::Text>(
+                        contents, i);
                 if (_status != NoError)
                 {
                     return;
                 }
 
                 // repeat attribute check
-                auto attr = newNode.GetNodeAttributes();
-                if (attr.find(attributeName) != attr.end())
+                if (!handler.Attribute(attributeName,
+                                       std::move(attributeValue)))
                 {
                     _status = AttributeRepeatError;
                     _errorIndex = i;
                     return;
                 }
-                newNode.AddNodeAttribute(attributeName, attributeValue);
             }
         }
 
         // [40] STag ::= '<' Name (S Attribute)* S? '>'
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseStartTag(std::string_view contents, size_t &i,
-                            XMLNode &current, std::stack<std::string> &tagStack)
+                            Handler &handler)
         {
             // read start tag name
             auto tag = _ParseName(contents, i);
@@ -894,11 +2660,10 @@ namespace Craft
                 _errorIndex = i;
                 return;
             }
-            tagStack.push(tag);
-            auto newNode = XMLNode(tag);
+            handler.StartElement(tag);
 
             // will read all space
-            _ParseAttribute(contents, i, newNode);
+            _ParseAttribute<Flags>(contents, i, handler);
             if (_status != NoError)
             {
                 return;
@@ -915,16 +2680,22 @@ namespace Craft
                     _errorIndex = i;
                     return;
                 }
-                current.AddChild(newNode);
-                tagStack.pop();
+                handler.EmptyElement();
                 ++i;
                 return;
             }
                 // tag end by >
             else if (contents[i] == '>')
             {
-                current.AddChild(newNode);
-                current = newNode;
+                // fail fast, before the document can grow any deeper
+                if (_maxDepth != 0 && _depth >= _maxDepth)
+                {
+                    _status = DepthLimitError;
+                    _errorIndex = i;
+                    return;
+                }
+                ++_depth;
+                handler.OpenElement();
                 ++i;
                 return;
             }
@@ -938,8 +2709,11 @@ namespace Craft
         }
 
         // [42]ETag	::= '</' Name S? '>'
+        // the handler know the open element, DOMBuilder match the tag of
+        // its current node instead of a stack of tag copies
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseEndTag(std::string_view contents, size_t &i,
-                          XMLNode &current, std::stack<std::string> &tagStack)
+                          Handler &handler)
         {
             // < (space)* /
             _ParseBlank(contents, i);
@@ -956,23 +2730,33 @@ namespace Craft
                 _errorIndex = i;
                 return;
             }
-            auto stackTop = tagStack.top();
-            if (tag != stackTop)
+            if (_depth == 0 || !handler.IsOpen(tag))
             {
                 _status = TagNotMatchedError;
                 _errorIndex = i;
+                if (_Has<Flags>(ParseRecover))
+                {
+                    _RecordError();
+                    ++i;
+                    for (auto n = handler.Enclosing(tag, _depth); n != 0; --n)
+                    {
+                        --_depth;
+                        handler.CloseElement();
+                    }
+                }
                 return;
             }
-            tagStack.pop();
+            --_depth;
             ++i;
-            current = current.GetParent();
+            handler.CloseElement();
         }
 
         //        [18]   	CDSect	   ::=   	CDStart CData CDEnd
         //        [19]   	CDStart	   ::=   	'<![CDATA['
         //        [20]   	CData	   ::=   	(Char* - (Char* ']]>'
         //        Char*)) [21]   	CDEnd	   ::=   	']]>'
-        void _ParseCDATA(std::string_view contents, size_t &i, XMLNode &current)
+        template<unsigned Flags = RuntimeFlags, typename Handler>
+        void _ParseCDATA(std::string_view contents, size_t &i, Handler &handler)
         {
             // can't nested
             // starts with <![CDATA[
@@ -985,14 +2769,11 @@ namespace Craft
                 _errorIndex = i;
                 return;
             }
-            if (_parseFlag & ParseCData)
+            if (_Has<Flags>(ParseCData))
             {
-                auto newNode =
-                    XMLNode("", std::string(contents.substr(first, i - first)),
-                            XMLNode::NodeType::NodeCData);
-                current.AddChild(newNode);
-                i += 3;
+                handler.CData(contents.substr(first, i - first));
             }
+            i += 3;
         }
 
         [[nodiscard]] bool _IsDOCTYPE(std::string_view contents, size_t i) const
@@ -1005,111 +2786,207 @@ namespace Craft
             return (c > 'A' && c < 'Z') || (c > 'a' && c < 'z');
         }
 
-        // not parse in actually, only skip and save doctype text
+        // only entity declarations of the internal subset are parsed,
+        // other declarations are skipped and the doctype text saved
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseDoctypeDecl(std::string_view contents, size_t &i,
-                               XMLNode &current)
+                               Handler &handler)
         {
             auto first = i;
             while (i < contents.size() && contents[i] != '>')
             {
                 if (contents[i] == '[')
                 {
-                    int depth = 1;
-                    i++;
-                    while (depth > 0)
+                    ++i;
+                    _ParseInternalSubset(contents, i);
+                    if (_status != NoError)
                     {
-                        if (contents[i] == '[')
-                        {
-                            ++depth;
-                        }
-                        else if (contents[i] == ']')
-                        {
-                            --depth;
-                        }
-                        ++i;
+                        return;
+                    }
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            ++i;
+            if (_Has<Flags>(ParseDoctype))
+            {
+                handler.Doctype(contents.substr(first, i - first - 1));
+            }
+        }
+
+        // [28b]intSubset ::= (markupdecl | DeclSep)*
+        // i point to the char after '[', move i after ']'
+        void _ParseInternalSubset(std::string_view contents, size_t &i)
+        {
+            while (i < contents.size() && contents[i] != ']')
+            {
+                if (contents.substr(i, 8) == "<!ENTITY")
+                {
+                    i += 8;
+                    _ParseEntityDecl(contents, i);
+                    if (_status != NoError)
+                    {
+                        return;
                     }
                 }
+                else if (contents.substr(i, 4) == "<!--")
+                {
+                    auto last = contents.find("-->", i + 4);
+                    i = last == std::string::npos ? contents.size() : last + 3;
+                }
+                else if (contents[i] == '"' || contents[i] == '\'')
+                {
+                    // literal of other declarations may contain ']'
+                    auto last = contents.find(contents[i], i + 1);
+                    i = last == std::string::npos ? contents.size() : last + 1;
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            if (i >= contents.size())
+            {
+                _status = PrologSyntaxError;
+                _errorIndex = i;
+                return;
+            }
+            ++i;
+        }
+
+        // [71]GEDecl ::= '<!ENTITY' S Name S EntityDef S? '>'
+        // [72]PEDecl ::= '<!ENTITY' S '%' S Name S PEDef S? '>'
+        // only internal general entities are kept, the first declaration
+        // of a name is binding
+        void _ParseEntityDecl(std::string_view contents, size_t &i)
+        {
+            _ParseBlank(contents, i);
+            bool isParameter = i < contents.size() && contents[i] == '%';
+            if (isParameter)
+            {
+                ++i;
+                _ParseBlank(contents, i);
+            }
+            auto name = _ParseName(contents, i);
+            if (name.empty())
+            {
+                _status = PrologSyntaxError;
+                _errorIndex = i;
+                return;
+            }
+            _ParseBlank(contents, i);
+            // EntityValue, otherwise a ExternalID which is not loaded
+            if (i < contents.size()
+                && (contents[i] == '"' || contents[i] == '\''))
+            {
+                auto last = contents.find(contents[i], i + 1);
+                if (last == std::string::npos)
+                {
+                    _status = PrologSyntaxError;
+                    _errorIndex = i;
+                    return;
+                }
+                if (!isParameter)
+                {
+                    _entities.emplace(name,
+                                      contents.substr(i + 1, last - i - 1));
+                }
+                i = last + 1;
+            }
+            while (i < contents.size() && contents[i] != '>')
+            {
+                if (contents[i] == '"' || contents[i] == '\'')
+                {
+                    auto last = contents.find(contents[i], i + 1);
+                    i = last == std::string::npos ? contents.size() : last + 1;
+                }
                 else
                 {
                     ++i;
                 }
             }
-            ++i;
-            if (_parseFlag & ParseDoctype)
+            if (i >= contents.size())
             {
-                auto content =
-                    std::string(contents.substr(first, i - first - 2));
-                auto newNode =
-                    XMLNode("", content, XMLNode::NodeType::NodeDoctype);
-                current.AddChild(newNode);
+                _status = PrologSyntaxError;
+                _errorIndex = i;
+                return;
             }
+            ++i;
         }
 
         // [22]prolog ::= XMLDecl? Misc* (doctypedecl Misc*)?
-        // [27]Misc ::= Comment | PI | S
+        template<unsigned Flags = RuntimeFlags, typename Handler>
         void _ParseProlog(std::string_view contents, size_t &i,
-                          XMLNode &current)
+                          Handler &handler)
         {
             _ParseBlank(contents, i);
             if (_IsXMLDeclarationStart(contents, i))
             {
                 i += 5;
-                _ParseDeclaration(contents, i, current);
+                _ParseDeclaration<Flags>(contents, i, handler);
             }
-            while (i < contents.size())
+            while (_status == NoError
+                   && _ParseMisc<Flags>(contents, i, handler))
             {
-                // comment pi space
-                _ParseBlank(contents, i);
-                if (contents[i] == '<')
+            }
+        }
+
+        // [27]Misc ::= Comment | PI | S
+        // one Misc or the doctypedecl, false at the root element, at the end
+        // of input or on error
+        template<unsigned Flags = RuntimeFlags, typename Handler>
+        bool _ParseMisc(std::string_view contents, size_t &i, Handler &handler)
+        {
+            _ParseBlank(contents, i);
+            if (i >= contents.size())
+            {
+                return false;
+            }
+            if (contents[i] != '<')
+            {
+                _status = PrologSyntaxError;
+                _errorIndex = i;
+                return false;
+            }
+            if (contents[i + 1] == '!')
+            {
+                i += 2;
+                if (contents[i] == '-' && contents[i + 1] == '-')
                 {
-                    if (contents[i + 1] == '!')
-                    {
-                        i += 2;
-                        if (contents[i] == '-' && contents[i + 1] == '-')
-                        {
-                            i += 2;
-                            _ParseComment(contents, i, current);
-                        }
-                        else if (contents[i] == 'D')
-                        {
-                            i += 2;
-                            _ParseDoctypeDecl(contents, i, current);
-                        }
-                        else
-                        {
-                            _status = PrologSyntaxError;
-                            _errorIndex = i;
-                            return;
-                        }
-                    }
-                    else if (contents[i + 1] == '?')
-                    {
-                        i += 2;
-                        _ParsePI(contents, i, current);
-                    }
-                    else
-                    {
-                        // element
-                        return;
-                    }
+                    i += 2;
+                    _ParseComment<Flags>(contents, i, handler);
+                }
+                else if (contents.substr(i, 7) == "DOCTYPE")
+                {
+                    i += 7;
+                    _ParseBlank(contents, i);
+                    _ParseDoctypeDecl<Flags>(contents, i, handler);
                 }
                 else
                 {
-                    // error
                     _status = PrologSyntaxError;
                     _errorIndex = i;
-                    return;
-                }
-                if (_status != NoError)
-                {
-                    return;
                 }
             }
+            else if (contents[i + 1] == '?')
+            {
+                i += 2;
+                _ParsePI<Flags>(contents, i, handler);
+            }
+            else
+            {
+                // element
+                return false;
+            }
+            return _status == NoError;
         }
 
         //[16]PI ::= '<?' PITarget (S (Char* - (Char* '?>' Char*)))? '?>'
         //[17]PITarget ::= Name - (('X' | 'x') ('M' | 'm') ('L' | 'l'))
-        void _ParsePI(std::string_view contents, size_t &i, XMLNode &current)
+        template<unsigned Flags = RuntimeFlags, typename Handler>
+        void _ParsePI(std::string_view contents, size_t &i, Handler &handler)
         {
             // match ? (0|1)
             if (_IsXML(contents, i))
@@ -1129,87 +3006,176 @@ namespace Craft
                 _errorIndex = i;
                 return;
             }
-            if (_parseFlag & ParsePI)
+            if (_Has<Flags>(ParsePI))
+            {
+                handler.PI(name, contents.substr(i, last - i));
+            }
+            i = last + 2;
+        }
+
+        // BOM and declaration based detection, UTF-16 and Latin-1 are
+        // transcoded to UTF-8 into _decoded, input in ASCII or UTF-8 is
+        // used in place, error index is then a offset of the original input
+        std::string_view _DecodeInput(std::string_view contents)
+        {
+            size_t bomSize = 0;
+            size_t errorIndex = 0;
+            auto encoding = Encoding::Detect(contents, bomSize);
+            switch (encoding)
             {
-                auto piContent = std::string(contents.substr(i, last - i));
-                auto newChild =
-                    XMLNode(name, piContent, XMLNode::NodeType::NodePI);
-                current.AddChild(newChild);
-                i = last + 2;
+                case Encoding::UTF16LE:
+                case Encoding::UTF16BE:
+                    if (!Encoding::UTF16ToUTF8(contents.substr(bomSize),
+                                               encoding == Encoding::UTF16LE,
+                                               _decoded, errorIndex))
+                    {
+                        _status = EncodingError;
+                        _errorIndex = static_cast<int>(bomSize + errorIndex);
+                        return {};
+                    }
+                    return _decoded;
+                case Encoding::Latin1:
+                    // the same bytes in UTF-8 if there is no accent
+                    if (Encoding::IsASCII(contents))
+                    {
+                        return contents;
+                    }
+                    Encoding::Latin1ToUTF8(contents, _decoded);
+                    return _decoded;
+                case Encoding::UTF8:
+                    contents.remove_prefix(bomSize);
+                    if ((_parseFlag & ParseValidateUTF8)
+                        && !Encoding::ValidateUTF8(contents, errorIndex))
+                    {
+                        _status = EncodingError;
+                        _errorIndex = static_cast<int>(bomSize + errorIndex);
+                        return {};
+                    }
+                    return contents;
+                default:
+                    return contents;
             }
         }
 
-        XMLNode _Parse(std::string_view contents)
+        template<unsigned Flags = RuntimeFlags>
+        XMLNode _Build(std::string_view contents)
         {
             auto root = XMLNode(XMLNode::NodeType::NodeDocument);
-            size_t i = 0;
-            // parse prolog and read to first <
-            _ParseProlog(contents, i, root);
+            DOMBuilder builder(root, _index, _Has<Flags>(ParseNamespaces),
+                               _Has<Flags>(ParseTextInParent));
+            _Parse<Flags>(contents, builder);
+            if (_status != NoError)
+            {
+                return root;
+            }
+            root.SetNodeContent("");
+            assert(root.GetParent()._node == nullptr);
+            assert(root.GetNodeTag().empty());
+            assert(root.GetNodeContent().empty());
+            assert(root.GetNodeAttributes().empty());
+            return root;
+        }
 
-            std::stack<std::string> tagStack;
-            auto current = root;
-            while (i < contents.size())
+        // parser may be reused by XMLDocument
+        void _Reset()
+        {
+            _status = NoError;
+            _errorIndex = -1;
+            _entities.clear();
+            _entityExpansion = 0;
+            _depth = 0;
+            _diagnostics.clear();
+        }
+
+        // a run time flag go to the parser specialized for it if there is
+        template<unsigned Flags = RuntimeFlags, typename Handler>
+        void _Parse(std::string_view contents, Handler &handler)
+        {
+            if constexpr (Flags == RuntimeFlags)
             {
-                if (contents[i] == '<')
+                if (_parseFlag == ParseFull)
                 {
-                    ++i;
-                    switch (contents[i])
-                    {
-                        case '?':
-                            // declaration must be first line which not null
-                            if (_IsXMLDeclarationStart(contents, i - 1))
-                            {
-                                _status = DeclarationPositionError;
-                                _errorIndex = i;
-                            }
-                            else
-                            {
-                                ++i;
-                                _ParsePI(contents, i, current);
-                            }
-                            break;
-                        case '/': // end tag </tag>
-                            i += 1;
-                            _ParseEndTag(contents, i, current, tagStack);
-                            break;
-                        case '!':
-                            if (contents[i + 1] == '-'
-                                && contents[i + 2] == '-')
-                            {
-                                i += 3;
-                                _ParseComment(contents, i, current);
-                                break;
-                            }
-                        default: // <tag>
-                            _ParseStartTag(contents, i, current, tagStack);
-                    }
+                    return _Parse<ParseFull>(contents, handler);
                 }
-                else
+                if (_parseFlag == ParseMinimal)
+                {
+                    return _Parse<ParseMinimal>(contents, handler);
+                }
+            }
+            _Reset();
+
+            // encoding error is a offset of the input
+            _source = contents;
+            contents = _DecodeInput(contents);
+            if (_status != NoError)
+            {
+                return;
+            }
+            _source = contents;
+            size_t i = 0;
+            // parse prolog and read to first <
+            _ParseProlog<Flags>(contents, i, handler);
+            if (_status != NoError)
+            {
+                if (!_Has<Flags>(ParseRecover))
                 {
-                    _ParseElementContent(contents, i, current);
+                    return;
                 }
+                _Resync(contents, i, 0);
+            }
+
+            while (i < contents.size())
+            {
+                auto first = i;
+                _ParseNext<Flags>(contents, i, handler);
                 if (_status != NoError)
                 {
-                    return root;
+                    if (!_Has<Flags>(ParseRecover))
+                    {
+                        return;
+                    }
+                    _Resync(contents, i, first);
                 }
             }
+            _ParseEnd(i);
+        }
 
-            if (current._node != root._node)
+        // i is the end of input, element still open there is a error
+        void _ParseEnd(size_t i)
+        {
+            if (_depth != 0)
             {
                 _status = TagNotMatchedError;
                 _errorIndex = i;
-                return root;
+                if (_parseFlag & ParseRecover)
+                {
+                    _RecordError();
+                }
+            }
+            if (!_diagnostics.empty())
+            {
+                _status = _diagnostics.front().status;
+                _errorIndex = _diagnostics.front().errorIndex;
             }
+        }
 
-            root.SetNodeContent("");
-            assert(root.GetParent()._node == nullptr);
-            assert(root.GetNodeTag().empty());
-            assert(root.GetNodeContent().empty());
-            assert(root.GetNodeAttributes().empty());
-            return root;
+        void _RecordError()
+        {
+            _diagnostics.push_back({_status, _errorIndex});
+            _status = NoError;
+        }
+
+        // skip to the next '<' after first, where the failed construct began
+        void _Resync(std::string_view contents, size_t &i, size_t first)
+        {
+            _RecordError();
+            i = contents.find('<', std::max(i, first + 1));
+            i = i == std::string_view::npos ? contents.size() : i;
         }
     };
 
+    // line, column and snippet are computed from the error offset once
+    // a parse failed, the parser itself never count lines
     class XMLParserResult
     {
     public:
@@ -1218,59 +3184,145 @@ namespace Craft
         {
         }
 
+        // source is the text errorIndex is a offset of, it is only read here
+        XMLParserResult(XMLParser::ParseStatus status, int errorIndex,
+                        std::string_view source) :
+            XMLParserResult(status, errorIndex)
+        {
+            if (status != XMLParser::NoError && errorIndex >= 0)
+            {
+                _Locate(source);
+            }
+        }
+
         [[nodiscard]] std::string ErrorInfo() const
         {
-            std::string errorName;
-            switch (_status)
+            return std::string(ErrorNames[_status]);
+        }
+
+        // 1-based, 0 if the error has no position
+        [[nodiscard]] size_t Line() const noexcept { return _line; }
+
+        // 1-based, counted in characters rather than bytes
+        [[nodiscard]] size_t Column() const noexcept { return _column; }
+
+        // the error line around the error offset, at most SnippetRadius
+        // bytes on each side
+        [[nodiscard]] const std::string &Snippet() const noexcept
+        {
+            return _snippet;
+        }
+
+        // e.g. TagNotMatchedError at line 3, column 7: <b></c>
+        [[nodiscard]] std::string Message() const
+        {
+            auto message = ErrorInfo();
+            if (_line != 0)
             {
-                case XMLParser::NoError:
-                    errorName = "NoError";
-                    break;
-                case XMLParser::FileOpenFailed:
-                    errorName = "FileOpenFailed";
-                    break;
-                case XMLParser::TagSyntaxError:
-                    errorName = "TagSyntaxError";
-                    break;
-                case XMLParser::TagBadCloseError:
-                    errorName = "TagBadCloseError";
-                    break;
-                case XMLParser::CommentSyntaxError:
-                    errorName = "CommentSyntaxError";
-                    break;
-                case XMLParser::TagNotMatchedError:
-                    errorName = "TagNotMatchedError";
-                    break;
-                case XMLParser::AttributeSyntaxError:
-                    errorName = "AttributeSyntaxError";
-                    break;
-                case XMLParser::AttributeRepeatError:
-                    errorName = "AttributeRepeatError";
-                    break;
-                case XMLParser::DeclarationSyntaxError:
-                    errorName = "DeclarationSyntaxError";
-                    break;
-                case XMLParser::DeclarationPositionError:
-                    errorName = "DeclarationPositionError";
-                    break;
-                case XMLParser::CDATASyntaxError:
-                    errorName = "CDATASyntaxError";
-                    break;
-                case XMLParser::PISyntaxError:
-                    errorName = "PISyntaxError";
-                    break;
-                case XMLParser::PrologSyntaxError:
-                    errorName = "PrologSyntaxError";
-                    break;
-                case XMLParser::CharReferenceError:
-                    errorName = "CharReferenceError";
-                    break;
+                message += " at line " + std::to_string(_line) + ", column "
+                           + std::to_string(_column) + ": " + _snippet;
             }
-            return errorName;
+            return message;
         }
 
         XMLParser::ParseStatus _status;
         int _errorIndex;
+
+    private:
+        static constexpr size_t SnippetRadius = 32;
+
+        // in the order of XMLParser::ParseStatus
+        static constexpr std::string_view ErrorNames[] = {
+            "NoError",
+            "FileOpenFailed",
+            "TagSyntaxError",
+            "TagBadCloseError",
+            "CommentSyntaxError",
+            "TagNotMatchedError",
+            "AttributeSyntaxError",
+            "AttributeRepeatError",
+            "DeclarationSyntaxError",
+            "DeclarationPositionError",
+            "CDATASyntaxError",
+            "PISyntaxError",
+            "PrologSyntaxError",
+            "CharReferenceError",
+            "EntityExpansionError",
+            "EncodingError",
+            "DepthLimitError",
+            "ValueConversionError",
+            "RootMismatchError"};
+        static_assert(std::size(ErrorNames)
+                      == XMLParser::RootMismatchError + 1);
+
+        size_t _line = 0;
+
+        size_t _column = 0;
+
+        std::string _snippet;
+
+        void _Locate(std::string_view source)
+        {
+            // error at the end of input may have a index past it
+            auto offset = std::min(static_cast<size_t>(_errorIndex),
+                                   source.size());
+            _line = 1 + _CountNewlines(source.data(), offset);
+            auto lineFirst = source.substr(0, offset).rfind('\n');
+            lineFirst = lineFirst == std::string_view::npos ? 0 : lineFirst + 1;
+            auto lineLast = std::min(source.find('\n', offset), source.size());
+            if (lineLast > lineFirst && source[lineLast - 1] == '\r')
+            {
+                --lineLast;
+            }
+            _column = 1;
+            for (auto k = lineFirst; k < offset; ++k)
+            {
+                _column += !_IsContinuation(source[k]);
+            }
+
+            auto first = std::max(lineFirst, offset - std::min(
+                                                 offset, SnippetRadius));
+            auto last = std::max(first, std::min(lineLast,
+                                                 offset + SnippetRadius));
+            // never cut a UTF-8 sequence
+            while (first < last && _IsContinuation(source[first]))
+            {
+                ++first;
+            }
+            while (last > first && last < lineLast
+                   && _IsContinuation(source[last]))
+            {
+                --last;
+            }
+            _snippet = source.substr(first, last - first);
+        }
+
+        static bool _IsContinuation(char c) noexcept
+        {
+            return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+        }
+
+        // 16 bytes at a time with SSE2
+        static size_t _CountNewlines(const char *s, size_t size) noexcept
+        {
+            size_t count = 0;
+            size_t i = 0;
+#ifdef __SSE2__
+            const auto newline = _mm_set1_epi8('\n');
+            for (; i + 16 <= size; i += 16)
+            {
+                auto block = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + i));
+                count += __builtin_popcount(static_cast<unsigned>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline))));
+            }
+#endif
+            for (; i < size; ++i)
+            {
+                count += s[i] == '\n';
+            }
+            return count;
+        }
     };
 
     class XMLDocument : public XMLNode
@@ -1281,19 +3333,216 @@ namespace Craft
         XMLParserResult LoadFile(const std::string &fileName,
                                  unsigned parseFlag = XMLParser::ParseFull)
         {
-            XMLParser parser;
-            _node = parser.ParseFile(fileName, parseFlag)._node;
-            return XMLParserResult(parser.Status(), parser.ErrorIndex());
+            return _Load(
+                [&]() { return _parser.ParseFile(fileName, parseFlag); });
         }
 
-        XMLParserResult LoadString(const std::string &str,
+        XMLParserResult LoadString(std::string_view str,
                                    unsigned parseFlag = XMLParser::ParseFull)
         {
-            XMLParser parser;
-            _node = parser.ParseString(str, parseFlag)._node;
-            return XMLParserResult(parser.Status(), parser.ErrorIndex());
+            return _Load(
+                [&]() { return _parser.ParseString(str, parseFlag); });
+        }
+
+        // with a parser specialized for Flags, see XMLParser::ParseString
+        template<unsigned Flags>
+        XMLParserResult LoadString(std::string_view str)
+        {
+            return _Load(
+                [&]() { return _parser.ParseString<Flags>(str); });
+        }
+
+        // copy node and its subtree to the end of this document, or every
+        // child of node if it is a document, e.g. to fan a template document
+        // out to many, the copy is indexed like any added node
+        // return the copy of node, or this document
+        XMLNode Import(const XMLNode &node)
+        {
+            if (_node->_frozen)
+            {
+                return _Null();
+            }
+            if (node.GetNodeType() != NodeType::NodeDocument)
+            {
+                auto copy = node.Clone();
+                AddChild(copy);
+                return copy;
+            }
+            // up to the last child it has now, node may be this document
+            auto *last = node._node->_lastChild->_prev;
+            for (auto *child = node._node->_firstChild; last != nullptr;
+                 child = child->_next)
+            {
+                XMLNode copy(_CloneTree(child));
+                AddChild(copy);
+                if (child == last)
+                {
+                    break;
+                }
+            }
+            return *this;
+        }
+
+        // give the nodes of the tree back to the pool and leave a empty
+        // document, for a document reused for many small loads
+        // no node of the old tree may be used after it
+        void Clear()
+        {
+            if (_index != nullptr)
+            {
+                _index->Clear();
+            }
+            auto *old = _node;
+            _node = _Pool().New("", "", NodeType::NodeDocument);
+            _node->_index = _index.get();
+            // a frozen tree may still be read by other threads
+            if (!old->_frozen)
+            {
+                _FreeTree(old);
+            }
+            _cleared = true;
+        }
+
+        // make the tree read only, every getter, walk and FindById can then
+        // be used from any number of threads at once without a lock, none
+        // of them allocate or write
+        // setters, AddChild, InsertBefore, RemoveChild, ... on its nodes do
+        // nothing, a clone of a node is not frozen
+        // Clear and Load* give the document a new tree and leave the frozen
+        // one to the handles still reading it, they must not run while
+        // other threads read the document itself (FindById)
+        void Freeze() noexcept
+        {
+            for (auto *node = _node; node != nullptr;
+                 node = _NextPreorder(node, _node))
+            {
+                node->_frozen = true;
+            }
+        }
+
+        // parser used by LoadFile and LoadString, to set limits before load
+        XMLParser &Parser() noexcept { return _parser; }
+
+        // index elements by the value of these attributes while parsing,
+        // and keep it up to date on AddChild and AddNodeAttribute
+        // set it before LoadFile/LoadString, or it index the current tree
+        // if it is not frozen
+        void SetIndexedAttributes(const std::vector<std::string> &names)
+        {
+            if (_node->_frozen)
+            {
+                return;
+            }
+            _index = std::make_shared<AttributeIndex>(names);
+            _node->_index = _index.get();
+            _index->AddSubtree(_node);
+        }
+
+        // O(1) lookup of element whose indexed attribute equal to id,
+        // attribute names are tried in the order they were set
+        [[nodiscard]] XMLNode FindById(std::string_view id) const
+        {
+            if (_index != nullptr)
+            {
+                for (auto &[name, table] : _index->tables)
+                {
+                    if (auto it = table.find(id); it != table.end())
+                    {
+                        return it->second;
+                    }
+                }
+            }
+            return _Null();
+        }
+
+        [[nodiscard]] XMLNode FindByAttribute(std::string_view name,
+                                              std::string_view value) const
+        {
+            if (_index != nullptr)
+            {
+                if (auto *table = _index->Find(name); table != nullptr)
+                {
+                    if (auto it = table->find(value); it != table->end())
+                    {
+                        return it->second;
+                    }
+                }
+            }
+            return _Null();
+        }
+
+        // backing of node blocks allocated from now on, e.g.
+        // MemoryPoolPolicy::PoolHugePage | MemoryPoolPolicy::PoolBindNumaNode
+        // before loading a document of gigabytes
+        // it apply to this thread and threads started later
+        static void SetNodePoolPolicy(unsigned policy) noexcept
+        {
+            NodePools::SetPolicy(policy);
+        }
+
+        [[nodiscard]] static unsigned NodePoolPolicy() noexcept
+        {
+            return _Pool().BlockPolicy();
+        }
+
+    private:
+        friend class XMLSnapshot;
+
+        XMLParser _parser;
+
+        std::shared_ptr<AttributeIndex> _index;
+
+        // root is the empty one left by Clear, nobody else know it
+        bool _cleared = false;
+
+        XMLNodeStruct *_TakeCleared() noexcept
+        {
+            auto *cleared = _cleared ? _node : nullptr;
+            _cleared = false;
+            return cleared;
+        }
+
+        static void _FreeCleared(XMLNodeStruct *cleared) noexcept
+        {
+            if (cleared != nullptr)
+            {
+                _FreeTree(cleared);
+            }
+        }
+
+        void _PrepareIndex(XMLParser &parser)
+        {
+            if (_index != nullptr)
+            {
+                _index->Clear();
+            }
+            parser._index = _index.get();
+        }
+
+        // parse() load the new tree with _parser
+        template<typename Parse>
+        XMLParserResult _Load(Parse &&parse)
+        {
+            _PrepareIndex(_parser);
+            auto *cleared = _TakeCleared();
+            _node = parse()._node;
+            _node->_index = _index.get();
+            _FreeCleared(cleared);
+            return XMLParserResult(_parser.Status(), _parser.ErrorIndex(),
+                                   _parser._source);
         }
     };
 } // namespace Craft
 
+#ifdef __cpp_lib_ranges
+// Range only hold a walk, iterators stay valid after it is destroyed
+template<typename Walk>
+inline constexpr bool
+    std::ranges::enable_borrowed_range<Craft::XMLNode::Range<Walk>> = true;
+
+template<typename Walk>
+inline constexpr bool
+    std::ranges::enable_view<Craft::XMLNode::Range<Walk>> = true;
+#endif
+
 #endif // CRAFT_XML_HPP
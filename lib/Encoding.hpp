@@ -0,0 +1,385 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_ENCODING_HPP
+#define CRAFT_ENCODING_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+namespace Craft
+{
+    // detect the encoding of a XML input and transcode it to UTF-8
+    // hot loops handle 16 bytes at a time with SSE2, or 8 bytes with plain
+    // 64 bit words, and only fall back to a byte loop outside ASCII
+    class Encoding
+    {
+    public:
+        enum Type
+        {
+            UTF8,
+            UTF16LE,
+            UTF16BE,
+            Latin1,
+            // declared but not supported, bytes are used as they are
+            Unknown
+        };
+
+        // by BOM, then by the first '<' in UTF-16, then by the encoding of
+        // XML declaration, bomSize is the number of bytes to skip
+        [[nodiscard]] static Type Detect(std::string_view contents,
+                                         size_t &bomSize) noexcept
+        {
+            bomSize = 0;
+            if (contents.substr(0, 3) == "\xEF\xBB\xBF")
+            {
+                bomSize = 3;
+                return UTF8;
+            }
+            if (contents.substr(0, 2) == "\xFF\xFE")
+            {
+                bomSize = 2;
+                return UTF16LE;
+            }
+            if (contents.substr(0, 2) == "\xFE\xFF")
+            {
+                bomSize = 2;
+                return UTF16BE;
+            }
+            // a document in UTF-8 never start with NUL
+            if (contents.substr(0, 2) == std::string_view("<\0", 2))
+            {
+                return UTF16LE;
+            }
+            if (contents.substr(0, 2) == std::string_view("\0<", 2))
+            {
+                return UTF16BE;
+            }
+            return _FromName(_DeclaredEncoding(contents));
+        }
+
+        // out is any sink with append(const char *, size_t)
+        template<typename Out>
+        static void AppendUTF8(char32_t c, Out &out)
+        {
+            char buffer[4];
+            out.append(buffer, _WriteUTF8(c, buffer) - buffer);
+        }
+
+        [[nodiscard]] static bool IsASCII(std::string_view contents) noexcept
+        {
+            return _ASCIILength(contents.data(), contents.size())
+                   == contents.size();
+        }
+
+        static void Latin1ToUTF8(std::string_view contents, std::string &out)
+        {
+            out.resize(contents.size() * 2);
+            auto *first = reinterpret_cast<const unsigned char *>(
+                contents.data());
+            auto *dest = out.data();
+            size_t i = 0;
+            while (i < contents.size())
+            {
+                // copy the ASCII run as it is
+                auto run = _ASCIILength(contents.data() + i,
+                                        contents.size() - i);
+                std::memcpy(dest, first + i, run);
+                dest += run;
+                i += run;
+                if (i < contents.size())
+                {
+                    *dest++ = static_cast<char>(0xC0 | (first[i] >> 6));
+                    *dest++ = static_cast<char>(0x80 | (first[i] & 0x3F));
+                    ++i;
+                }
+            }
+            out.resize(dest - out.data());
+        }
+
+        // return false on a odd size or unpaired surrogate,
+        // errorIndex is then the byte offset of the bad code unit
+        static bool UTF16ToUTF8(std::string_view contents, bool littleEndian,
+                                std::string &out, size_t &errorIndex)
+        {
+            if (contents.size() % 2 != 0)
+            {
+                errorIndex = contents.size() - 1;
+                return false;
+            }
+            // a code unit never need more than 3 bytes,
+            // surrogate pair is 2 units for 4 bytes
+            out.resize(contents.size() / 2 * 3);
+            auto *src = reinterpret_cast<const unsigned char *>(
+                contents.data());
+            auto *dest = out.data();
+            size_t i = 0;
+            while (i < contents.size())
+            {
+                auto run = _ASCIIUnits(src + i, contents.size() - i,
+                                       littleEndian, dest);
+                dest += run;
+                i += run * 2;
+                if (i >= contents.size())
+                {
+                    break;
+                }
+                char32_t c = _Unit(src + i, littleEndian);
+                i += 2;
+                if (c >= 0xD800 && c <= 0xDBFF)
+                {
+                    char32_t low = i < contents.size()
+                                       ? _Unit(src + i, littleEndian)
+                                       : 0;
+                    if (low < 0xDC00 || low > 0xDFFF)
+                    {
+                        errorIndex = i - 2;
+                        return false;
+                    }
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    i += 2;
+                }
+                else if (c >= 0xDC00 && c <= 0xDFFF)
+                {
+                    errorIndex = i - 2;
+                    return false;
+                }
+                dest = _WriteUTF8(c, dest);
+            }
+            out.resize(dest - out.data());
+            return true;
+        }
+
+        // reject ill-formed sequence, overlong form, surrogate and code point
+        // above 0x10FFFF, errorIndex is the offset of the bad sequence
+        [[nodiscard]] static bool ValidateUTF8(std::string_view contents,
+                                               size_t &errorIndex) noexcept
+        {
+            auto *s = reinterpret_cast<const unsigned char *>(contents.data());
+            auto size = contents.size();
+            size_t i = 0;
+            while (i < size)
+            {
+                i += _ASCIILength(contents.data() + i, size - i);
+                if (i >= size)
+                {
+                    break;
+                }
+                auto c = s[i];
+                size_t length = 0;
+                unsigned char low = 0x80, high = 0xBF;
+                if (c >= 0xC2 && c <= 0xDF)
+                {
+                    length = 2;
+                }
+                else if (c >= 0xE0 && c <= 0xEF)
+                {
+                    length = 3;
+                    low = c == 0xE0 ? 0xA0 : 0x80;
+                    high = c == 0xED ? 0x9F : 0xBF;
+                }
+                else if (c >= 0xF0 && c <= 0xF4)
+                {
+                    length = 4;
+                    low = c == 0xF0 ? 0x90 : 0x80;
+                    high = c == 0xF4 ? 0x8F : 0xBF;
+                }
+                if (length == 0 || i + length > size || s[i + 1] < low
+                    || s[i + 1] > high)
+                {
+                    errorIndex = i;
+                    return false;
+                }
+                for (size_t k = 2; k < length; ++k)
+                {
+                    if ((s[i + k] & 0xC0) != 0x80)
+                    {
+                        errorIndex = i;
+                        return false;
+                    }
+                }
+                i += length;
+            }
+            return true;
+        }
+
+    private:
+        // value of encoding="..." in <?xml ... ?>, empty if none
+        static std::string_view
+        _DeclaredEncoding(std::string_view contents) noexcept
+        {
+            if (contents.substr(0, 5) != "<?xml")
+            {
+                return {};
+            }
+            auto declaration = contents.substr(0, contents.find("?>"));
+            auto i = declaration.find("encoding");
+            if (i == std::string_view::npos)
+            {
+                return {};
+            }
+            i = declaration.find_first_not_of("\x20\x09\x0d\x0A", i + 8);
+            if (i == std::string_view::npos || declaration[i] != '=')
+            {
+                return {};
+            }
+            i = declaration.find_first_not_of("\x20\x09\x0d\x0A", i + 1);
+            if (i == std::string_view::npos
+                || (declaration[i] != '"' && declaration[i] != '\''))
+            {
+                return {};
+            }
+            auto last = declaration.find(declaration[i], i + 1);
+            if (last == std::string_view::npos)
+            {
+                return {};
+            }
+            return declaration.substr(i + 1, last - i - 1);
+        }
+
+        static bool _EqualNoCase(std::string_view lhs,
+                                 std::string_view rhs) noexcept
+        {
+            if (lhs.size() != rhs.size())
+            {
+                return false;
+            }
+            for (size_t i = 0; i < lhs.size(); ++i)
+            {
+                auto l = lhs[i] >= 'a' && lhs[i] <= 'z' ? lhs[i] - 32 : lhs[i];
+                auto r = rhs[i] >= 'a' && rhs[i] <= 'z' ? rhs[i] - 32 : rhs[i];
+                if (l != r)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static Type _FromName(std::string_view name) noexcept
+        {
+            // US-ASCII is a subset of UTF-8
+            if (name.empty() || _EqualNoCase(name, "UTF-8")
+                || _EqualNoCase(name, "UTF8") || _EqualNoCase(name, "US-ASCII")
+                || _EqualNoCase(name, "ASCII"))
+            {
+                return UTF8;
+            }
+            if (_EqualNoCase(name, "ISO-8859-1")
+                || _EqualNoCase(name, "ISO_8859-1")
+                || _EqualNoCase(name, "LATIN1") || _EqualNoCase(name, "L1"))
+            {
+                return Latin1;
+            }
+            return Unknown;
+        }
+
+        // number of leading bytes below 0x80
+        static size_t _ASCIILength(const char *s, size_t size) noexcept
+        {
+            size_t i = 0;
+#ifdef __SSE2__
+            for (; i + 16 <= size; i += 16)
+            {
+                auto block = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + i));
+                if (auto mask = _mm_movemask_epi8(block); mask != 0)
+                {
+                    return i + __builtin_ctz(static_cast<unsigned>(mask));
+                }
+            }
+#endif
+            for (; i + 8 <= size; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, s + i, 8);
+                if (word & 0x8080808080808080ULL)
+                {
+                    break;
+                }
+            }
+            while (i < size && static_cast<unsigned char>(s[i]) < 0x80)
+            {
+                ++i;
+            }
+            return i;
+        }
+
+        static char32_t _Unit(const unsigned char *s,
+                              bool littleEndian) noexcept
+        {
+            return littleEndian ? s[0] | (s[1] << 8) : (s[0] << 8) | s[1];
+        }
+
+        // narrow the leading run of ASCII code units into dest,
+        // return the number of units
+        static size_t _ASCIIUnits(const unsigned char *s, size_t size,
+                                  bool littleEndian, char *dest) noexcept
+        {
+            size_t i = 0;
+#ifdef __SSE2__
+            const auto highBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const auto zero = _mm_setzero_si128();
+            for (; i + 16 <= size; i += 16)
+            {
+                auto block = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s + i));
+                if (!littleEndian)
+                {
+                    block = _mm_or_si128(_mm_slli_epi16(block, 8),
+                                         _mm_srli_epi16(block, 8));
+                }
+                auto isASCII = _mm_cmpeq_epi16(
+                    _mm_and_si128(block, highBits), zero);
+                if (_mm_movemask_epi8(isASCII) != 0xFFFF)
+                {
+                    break;
+                }
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + i / 2),
+                                 _mm_packus_epi16(block, block));
+            }
+#endif
+            while (i + 2 <= size && _Unit(s + i, littleEndian) < 0x80)
+            {
+                dest[i / 2] = static_cast<char>(s[littleEndian ? i : i + 1]);
+                i += 2;
+            }
+            return i / 2;
+        }
+
+        static char *_WriteUTF8(char32_t c, char *dest) noexcept
+        {
+            if (c < 0x80)
+            {
+                *dest++ = static_cast<char>(c);
+            }
+            else if (c < 0x800)
+            {
+                *dest++ = static_cast<char>(0xC0 | (c >> 6));
+                *dest++ = static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                *dest++ = static_cast<char>(0xE0 | (c >> 12));
+                *dest++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *dest++ = static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                *dest++ = static_cast<char>(0xF0 | (c >> 18));
+                *dest++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                *dest++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                *dest++ = static_cast<char>(0x80 | (c & 0x3F));
+            }
+            return dest;
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_ENCODING_HPP
@@ -6,9 +6,43 @@
 #define CRAFT_MEMORYPOOL_HPP
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
 
 namespace Craft
 {
+    // how the memory behind a block is obtained, combine flag with |
+    // policy only affect blocks allocated after it is set
+    struct MemoryPoolPolicy
+    {
+        static constexpr unsigned PoolDefault = 0;
+
+        // use LargeBlockSize blocks instead of BlockSize
+        // a DOM of gigabytes then need far fewer blocks and allocations
+        static constexpr unsigned PoolLargeBlock = 1;
+
+        // large block and madvise(MADV_HUGEPAGE) where available,
+        // one TLB entry then covers a whole block
+        static constexpr unsigned PoolHugePage = 1 << 1;
+
+        // prefer the NUMA node of the thread which allocate the block,
+        // useful when parse threads are pinned per socket
+        static constexpr unsigned PoolBindNumaNode = 1 << 2;
+
+        // huge page size on x86-64 and most aarch64 kernels
+        static constexpr std::size_t LargeBlockSize = 2 * 1024 * 1024;
+    };
+
     // page size often 4096
     template<typename T, unsigned BlockSize = 4096>
     class MemoryPool : public std::allocator<T>
@@ -26,18 +60,25 @@ namespace Craft
         using propagate_on_container_move_assignment = std::true_type;
         using propagate_on_container_swap = std::true_type;
 
-        MemoryPool() : _currentBlock(new MemBlock()), _freeList(nullptr) {}
+        MemoryPool() : MemoryPool(MemoryPoolPolicy::PoolDefault) {}
+
+        explicit MemoryPool(unsigned policy) :
+            _firstBlock(new MemBlock(_BlockSize(policy), policy)),
+            _currentBlock(_firstBlock), _freeList(nullptr), _policy(policy)
+        {
+        }
 
         ~MemoryPool()
         {
-            auto *currentBlock = _currentBlock;
-            while (currentBlock->next != _currentBlock)
+            // blocks are linked from first to current, current->next is itself
+            auto *block = _firstBlock;
+            while (block != nullptr && block != _currentBlock)
             {
-                auto *prevBlock = currentBlock;
-                currentBlock = currentBlock->next;
-                delete prevBlock;
+                auto *nextBlock = block->next;
+                delete block;
+                block = nextBlock;
             }
-            delete currentBlock;
+            delete _currentBlock;
         }
 
         MemoryPool(const MemoryPool &) = delete;
@@ -45,15 +86,20 @@ namespace Craft
 
         MemoryPool(MemoryPool &&rhs) noexcept
         {
-            swap(this, rhs);
+            swap(*this, rhs);
         }
 
         MemoryPool& operator=(MemoryPool &&rhs) noexcept
         {
-            swap(this, rhs);
+            swap(*this, rhs);
             return *this;
         }
 
+        // set the backing of blocks allocated later, see MemoryPoolPolicy
+        void SetBlockPolicy(unsigned policy) noexcept { _policy = policy; }
+
+        [[nodiscard]] unsigned BlockPolicy() const noexcept { return _policy; }
+
         template <typename U>
         struct rebind
         {
@@ -62,22 +108,26 @@ namespace Craft
 
         struct MemBlock
         {
-            MemBlock()
+            MemBlock(size_type size, unsigned policy) : size(size)
             {
                 next = this;
-                memBlock =
-                    reinterpret_cast<mem_type>(operator new(BlockSize));
+                memBlock = _AllocBlockMemory(size, policy, isMapped);
                 // align
-                currentPosition = memBlock + BlockSize % sizeof(T);
-                lastPosition = memBlock + BlockSize;
+                currentPosition = memBlock + size % sizeof(T);
+                lastPosition = memBlock + size;
             }
 
-            ~MemBlock() { operator delete(memBlock);}
+            ~MemBlock() { _FreeBlockMemory(memBlock, size, isMapped); }
 
             MemBlock *next;
 
             mem_type memBlock;
 
+            size_type size;
+
+            // true if memBlock come from mmap instead of operator new
+            bool isMapped = false;
+
             mem_type currentPosition;
 
             mem_type lastPosition;
@@ -167,26 +217,130 @@ namespace Craft
         }
 
     private:
-        MemBlock *_currentBlock;
+        MemBlock *_firstBlock = nullptr;
+
+        MemBlock *_currentBlock = nullptr;
 
         union FreeNode{
             T val;
             FreeNode *next;
         };
-        FreeNode *_freeList;
+        FreeNode *_freeList = nullptr;
+
+        unsigned _policy = MemoryPoolPolicy::PoolDefault;
 
-        void swap(MemoryPool& lhs, MemoryPool& rhs)
+        void swap(MemoryPool& lhs, MemoryPool& rhs) noexcept
         {
-            std::swap(_currentBlock);
-            std::swap(_freeList);
+            std::swap(lhs._firstBlock, rhs._firstBlock);
+            std::swap(lhs._currentBlock, rhs._currentBlock);
+            std::swap(lhs._freeList, rhs._freeList);
+            std::swap(lhs._policy, rhs._policy);
         }
 
         // 申请的内存不够时再增加新的block
         void _AllocNewBlock(MemBlock *currentBlock)
         {
-            auto *block = new MemBlock();
+            auto *block = new MemBlock(_BlockSize(_policy), _policy);
             currentBlock->next = block;
         }
+
+        static size_type _BlockSize(unsigned policy) noexcept
+        {
+            if (policy
+                & (MemoryPoolPolicy::PoolLargeBlock
+                   | MemoryPoolPolicy::PoolHugePage))
+            {
+                return MemoryPoolPolicy::LargeBlockSize;
+            }
+            return BlockSize;
+        }
+
+        // large blocks are mapped directly and aligned to LargeBlockSize,
+        // so that the kernel can back them with a huge page
+        static mem_type _AllocBlockMemory(size_type size, unsigned policy,
+                                          bool &isMapped)
+        {
+            isMapped = false;
+#ifdef __linux__
+            if (size >= MemoryPoolPolicy::LargeBlockSize)
+            {
+                auto *p = _MapAligned(size, MemoryPoolPolicy::LargeBlockSize);
+                if (p != nullptr)
+                {
+    #ifdef MADV_HUGEPAGE
+                    if (policy & MemoryPoolPolicy::PoolHugePage)
+                    {
+                        madvise(p, size, MADV_HUGEPAGE);
+                    }
+    #endif
+                    if (policy & MemoryPoolPolicy::PoolBindNumaNode)
+                    {
+                        _BindToLocalNode(p, size);
+                    }
+                    isMapped = true;
+                    return reinterpret_cast<mem_type>(p);
+                }
+            }
+#endif
+            return reinterpret_cast<mem_type>(operator new(size));
+        }
+
+        static void _FreeBlockMemory(mem_type p, size_type size,
+                                     bool isMapped) noexcept
+        {
+#ifdef __linux__
+            if (isMapped)
+            {
+                munmap(p, size);
+                return;
+            }
+#endif
+            operator delete(p);
+        }
+
+#ifdef __linux__
+        // map size + align bytes and unmap the unaligned head and tail
+        static void *_MapAligned(size_type size, size_type align) noexcept
+        {
+            auto mapSize = size + align;
+            void *p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+            {
+                return nullptr;
+            }
+            auto first = reinterpret_cast<std::uintptr_t>(p);
+            auto aligned = (first + align - 1) & ~(align - 1);
+            auto head = aligned - first;
+            if (head != 0)
+            {
+                munmap(p, head);
+            }
+            if (auto tail = mapSize - head - size; tail != 0)
+            {
+                munmap(reinterpret_cast<void *>(aligned + size), tail);
+            }
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        // pages are not touched yet, so the policy decide where they fault in
+        static void _BindToLocalNode(void *p, size_type size) noexcept
+        {
+    #if defined(SYS_getcpu) && defined(SYS_mbind)
+            unsigned cpu = 0, node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0
+                || node >= std::numeric_limits<unsigned long>::digits)
+            {
+                return;
+            }
+            unsigned long nodeMask = 1UL << node;
+            // MPOL_PREFERRED, fall back to other nodes when the local is full
+            constexpr int preferredPolicy = 1;
+            syscall(SYS_mbind, p, size, preferredPolicy, &nodeMask,
+                    std::numeric_limits<unsigned long>::digits + 1, 0);
+    #endif
+        }
+#endif
     };
 } // namespace Craft
 #endif // CRAFT_MEMORYPOOL_HPP
@@ -0,0 +1,260 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_RECORD_SPLITTER_HPP
+#define CRAFT_RECORD_SPLITTER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    // split a feed like <feed><record>...</record><record>...</record></feed>
+    // into its record elements, and parse them on several threads, each
+    // record into a small XMLDocument of its own
+    // the scan only stop at '<', comments, CDATA and PI are skipped and a
+    // record nested in a record of the same name belong to the outer one
+    // entities declared in DOCTYPE of the feed are not seen by records
+    class RecordSplitter
+    {
+    public:
+        explicit RecordSplitter(std::string recordTag,
+                                unsigned parseFlag = XMLParser::ParseFull) :
+            _tag(std::move(recordTag)),
+            _parseFlag(parseFlag)
+        {
+        }
+
+        // record elements in document order, as views into contents
+        // a record which is not closed run to the end of contents
+        [[nodiscard]] std::vector<std::string_view>
+        Split(std::string_view contents) const
+        {
+            std::vector<std::string_view> records;
+            size_t depth = 0;
+            size_t first = 0;
+            auto i = contents.find('<');
+            while (i != std::string_view::npos)
+            {
+                auto markupFirst = i;
+                auto markup = _NextMarkup(contents, i);
+                if (markup == RecordStart && depth++ == 0)
+                {
+                    first = markupFirst;
+                }
+                else if (markup == RecordEmpty && depth == 0)
+                {
+                    records.push_back(
+                        contents.substr(markupFirst, i - markupFirst));
+                }
+                else if (markup == RecordEnd && depth != 0 && --depth == 0)
+                {
+                    records.push_back(contents.substr(first, i - first));
+                }
+                i = contents.find('<', i);
+            }
+            if (depth != 0)
+            {
+                records.push_back(contents.substr(first));
+            }
+            return records;
+        }
+
+        // parse every record of contents on threads (0 is one per core) and
+        // call callback(index, record, document, result) once per record,
+        // offsets of result are relative to record
+        // ordered callbacks are called one at a time in record order,
+        // unordered ones as soon as a record is parsed and at the same time
+        // on several threads
+        // document and its nodes are only valid during the callback, they
+        // are then given back to the pool of the worker
+        // the first exception of a callback stop the parse and is rethrown
+        // return the number of records
+        template<typename Callback>
+        size_t Parse(std::string_view contents, Callback &&callback,
+                     bool ordered = true, unsigned threads = 0) const
+        {
+            auto records = Split(contents);
+            if (threads == 0)
+            {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            threads = static_cast<unsigned>(
+                std::min<size_t>(threads, records.size()));
+
+            std::atomic<size_t> next = 0;
+            std::atomic<bool> stop = false;
+            // next record to deliver in order
+            size_t delivered = 0;
+            std::mutex mutex;
+            std::condition_variable deliveredChanged;
+            std::exception_ptr error;
+
+            auto work = [&]() {
+                XMLDocument document;
+                // a load free the root left by Clear, not the one of the
+                // constructor
+                document.Clear();
+                size_t index;
+                while (!stop && (index = next++) < records.size())
+                {
+                    auto result = document.LoadString(records[index],
+                                                      _parseFlag);
+                    try
+                    {
+                        if (ordered)
+                        {
+                            std::unique_lock lock(mutex);
+                            deliveredChanged.wait(lock, [&]() {
+                                return delivered == index || stop;
+                            });
+                            if (stop)
+                            {
+                                lock.unlock();
+                                document.Clear();
+                                break;
+                            }
+                            // only this thread may deliver now
+                            lock.unlock();
+                            callback(index, records[index], document, result);
+                            lock.lock();
+                            ++delivered;
+                            deliveredChanged.notify_all();
+                        }
+                        else
+                        {
+                            callback(index, records[index], document, result);
+                        }
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(mutex);
+                        if (error == nullptr)
+                        {
+                            error = std::current_exception();
+                        }
+                        stop = true;
+                        deliveredChanged.notify_all();
+                    }
+                    document.Clear();
+                }
+                XMLNode::_FreeTree(document._node);
+            };
+
+            std::vector<std::thread> workers;
+            for (unsigned k = 1; k < threads; ++k)
+            {
+                workers.emplace_back(work);
+            }
+            if (threads != 0)
+            {
+                work();
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+            if (error != nullptr)
+            {
+                std::rethrow_exception(error);
+            }
+            return records.size();
+        }
+
+    private:
+        enum Markup
+        {
+            Other,
+            RecordStart,
+            RecordEmpty,
+            RecordEnd
+        };
+
+        std::string _tag;
+
+        unsigned _parseFlag;
+
+        // i point to a '<', move it after the markup
+        Markup _NextMarkup(std::string_view contents, size_t &i) const
+        {
+            auto rest = contents.substr(i + 1);
+            if (rest.substr(0, 3) == "!--")
+            {
+                i = _After(contents, "-->", i + 4);
+                return Other;
+            }
+            if (rest.substr(0, 8) == "![CDATA[")
+            {
+                i = _After(contents, "]]>", i + 9);
+                return Other;
+            }
+            if (rest.substr(0, 1) == "?")
+            {
+                i = _After(contents, "?>", i + 2);
+                return Other;
+            }
+            bool isEnd = rest.substr(0, 1) == "/";
+            auto name = rest.substr(isEnd ? 1 : 0);
+            bool isRecord = name.size() > _tag.size()
+                            && name.substr(0, _tag.size()) == _tag
+                            && _IsNameEnd(name[_tag.size()]);
+            i = _TagEnd(contents, i + 1);
+            if (!isRecord)
+            {
+                return Other;
+            }
+            if (isEnd)
+            {
+                return RecordEnd;
+            }
+            return i >= 2 && contents[i - 1] == '>' && contents[i - 2] == '/'
+                       ? RecordEmpty
+                       : RecordStart;
+        }
+
+        static bool _IsNameEnd(char c) noexcept
+        {
+            return c == '>' || c == '/' || c == ' ' || c == '\t' || c == '\r'
+                   || c == '\n';
+        }
+
+        static size_t _After(std::string_view contents, std::string_view end,
+                             size_t i) noexcept
+        {
+            i = contents.find(end, std::min(i, contents.size()));
+            return i == std::string_view::npos ? contents.size()
+                                               : i + end.size();
+        }
+
+        // after the '>' of a tag, a '>' in a attribute value doesn't end it
+        static size_t _TagEnd(std::string_view contents, size_t i) noexcept
+        {
+            while ((i = contents.find_first_of("\"'>", i))
+                   != std::string_view::npos)
+            {
+                if (contents[i] == '>')
+                {
+                    return i + 1;
+                }
+                i = contents.find(contents[i], i + 1);
+                if (i == std::string_view::npos)
+                {
+                    break;
+                }
+                ++i;
+            }
+            return contents.size();
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_RECORD_SPLITTER_HPP
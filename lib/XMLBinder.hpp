@@ -0,0 +1,373 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_BINDER_HPP
+#define CRAFT_XML_BINDER_HPP
+
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "XMLReader.hpp"
+
+namespace Craft
+{
+    struct XMLFieldKind
+    {
+        // attribute of the element
+        static constexpr unsigned Attribute = 0;
+
+        // child element, repeated if the member is a std::vector
+        static constexpr unsigned Child = 1;
+
+        // text of the element
+        static constexpr unsigned Text = 2;
+    };
+
+    // how a member of Class is read from a element
+    template<typename Class, typename Member, unsigned Kind>
+    struct XMLField
+    {
+        static constexpr unsigned kind = Kind;
+
+        std::string_view name;
+        Member Class::*member;
+    };
+
+    template<typename Class, typename Member>
+    constexpr auto XMLAttribute(std::string_view name, Member Class::*member)
+    {
+        return XMLField<Class, Member, XMLFieldKind::Attribute> {name, member};
+    }
+
+    template<typename Class, typename Member>
+    constexpr auto XMLChild(std::string_view name, Member Class::*member)
+    {
+        return XMLField<Class, Member, XMLFieldKind::Child> {name, member};
+    }
+
+    template<typename Class, typename Member>
+    constexpr auto XMLText(Member Class::*member)
+    {
+        return XMLField<Class, Member, XMLFieldKind::Text> {{}, member};
+    }
+
+    // specialize it for each struct to bind, e.g.
+    //
+    //     template<>
+    //     struct XMLSchema<Item>
+    //     {
+    //         static constexpr std::string_view tag = "item";
+    //         static constexpr auto fields = std::tuple {
+    //             XMLAttribute("id", &Item::id),
+    //             XMLChild("price", &Item::price),
+    //             XMLChild("tag", &Item::tags)};
+    //     };
+    //
+    // a member is a std::string, bool, a arithmetic type, a struct with a
+    // schema, or a std::vector of them for repeated child elements
+    // tag is optional, the root element must have it when it is given
+    template<typename T>
+    struct XMLSchema;
+
+    template<typename T>
+    concept HasXMLSchema = requires { XMLSchema<T>::fields; };
+
+    template<typename T>
+    concept HasXMLTag = requires { XMLSchema<T>::tag; };
+
+    // member bound to repeated child elements
+    template<typename T>
+    concept IsXMLRepeated =
+        std::is_same_v<T, std::vector<typename T::value_type,
+                                      typename T::allocator_type>>;
+
+    // parse straight into structs, with no tree in between
+    // tokens come from XMLReader, numbers are converted by from_chars,
+    // unknown elements and attributes are skipped
+    class XMLBinder
+    {
+    public:
+        // the root element is bound to object, the parse stop at its end
+        // a value which doesn't convert fail with ValueConversionError, a
+        // root which isn't the tag of the schema with RootMismatchError
+        template<typename T>
+        static XMLParserResult Parse(std::string_view contents, T &object,
+                                     unsigned parseFlag = XMLParser::ParseFull)
+        {
+            static_assert(HasXMLSchema<T>, "specialize XMLSchema<T> first");
+            XMLBinder binder(contents, parseFlag);
+            while (binder._status == XMLParser::NoError)
+            {
+                auto token = binder._Next();
+                if (token.type == XMLToken::StartElement)
+                {
+                    if constexpr (HasXMLTag<T>)
+                    {
+                        if (token.name != XMLSchema<T>::tag)
+                        {
+                            binder._status = XMLParser::RootMismatchError;
+                            binder._errorIndex = binder._reader.Offset();
+                            break;
+                        }
+                    }
+                    binder._BindElement(object);
+                    break;
+                }
+                if (token.type == XMLToken::End)
+                {
+                    break;
+                }
+            }
+            return XMLParserResult(binder._status,
+                                   static_cast<int>(binder._errorIndex),
+                                   binder._reader.Input());
+        }
+
+    private:
+        XMLReader _reader;
+
+        XMLParser::ParseStatus _status = XMLParser::NoError;
+
+        size_t _errorIndex = 0;
+
+        // text of a scalar element which is not a string, reused
+        std::string _text;
+
+        XMLBinder(std::string_view contents, unsigned parseFlag) :
+            _reader(contents, parseFlag)
+        {
+        }
+
+        XMLToken _Next()
+        {
+            auto token = _reader.Next();
+            if (token.type == XMLToken::Error)
+            {
+                _status = _reader.Status();
+                _errorIndex = _reader.ErrorIndex();
+            }
+            return token;
+        }
+
+        // f(field) for fields of T until one return true
+        template<typename T, typename F>
+        static constexpr bool _AnyField(F &&f)
+        {
+            return std::apply(
+                [&](const auto &... field) { return (f(field) || ...); },
+                XMLSchema<T>::fields);
+        }
+
+        template<typename Field>
+        static constexpr unsigned KindOf = std::remove_cvref_t<Field>::kind;
+
+        template<typename T>
+        static constexpr bool _HasTextField()
+        {
+            return _AnyField<T>([](const auto &field) {
+                return KindOf<decltype(field)> == XMLFieldKind::Text;
+            });
+        }
+
+        // called after the StartElement of object, return after its
+        // EndElement
+        template<typename T>
+        void _BindElement(T &object)
+        {
+            if constexpr (HasXMLSchema<T>)
+            {
+                for (auto &attribute : _reader.Attributes())
+                {
+                    _AnyField<T>([&](const auto &field) {
+                        if constexpr (KindOf<decltype(field)>
+                                      == XMLFieldKind::Attribute)
+                        {
+                            if (field.name == attribute.name)
+                            {
+                                _Convert(attribute.value,
+                                         object.*field.member);
+                                return true;
+                            }
+                        }
+                        return false;
+                    });
+                }
+                std::string text;
+                while (_status == XMLParser::NoError)
+                {
+                    auto token = _Next();
+                    switch (token.type)
+                    {
+                        case XMLToken::StartElement:
+                            if (!_AnyField<T>([&](const auto &field) {
+                                    if constexpr (KindOf<decltype(field)>
+                                                  == XMLFieldKind::Child)
+                                    {
+                                        if (field.name == token.name)
+                                        {
+                                            _BindChild(object.*field.member);
+                                            return true;
+                                        }
+                                    }
+                                    return false;
+                                }))
+                            {
+                                _Skip();
+                            }
+                            break;
+                        case XMLToken::Text:
+                        case XMLToken::CData:
+                            if constexpr (_HasTextField<T>())
+                            {
+                                text.append(token.value);
+                            }
+                            break;
+                        case XMLToken::EndElement:
+                            _AnyField<T>([&](const auto &field) {
+                                if constexpr (KindOf<decltype(field)>
+                                              == XMLFieldKind::Text)
+                                {
+                                    _Take(text, object.*field.member);
+                                    return true;
+                                }
+                                return false;
+                            });
+                            return;
+                        case XMLToken::End:
+                        case XMLToken::Error:
+                            return;
+                        default:
+                            break;
+                    }
+                }
+            }
+            else
+            {
+                // a string is read straight into it
+                auto &text = _TextBuffer(object);
+                text.clear();
+                size_t depth = 0;
+                while (_status == XMLParser::NoError)
+                {
+                    auto token = _Next();
+                    if (token.type == XMLToken::StartElement)
+                    {
+                        ++depth;
+                    }
+                    else if (token.type == XMLToken::EndElement && depth-- == 0)
+                    {
+                        if constexpr (!std::is_same_v<T, std::string>)
+                        {
+                            _Convert(_text, object);
+                        }
+                        return;
+                    }
+                    else if (depth == 0
+                             && (token.type == XMLToken::Text
+                                 || token.type == XMLToken::CData))
+                    {
+                        text.append(token.value);
+                    }
+                    else if (token.type == XMLToken::End)
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+
+        template<typename Member>
+        void _BindChild(Member &member)
+        {
+            if constexpr (IsXMLRepeated<Member>)
+            {
+                using Value = typename Member::value_type;
+                if constexpr (HasXMLSchema<Value>)
+                {
+                    _BindElement(member.emplace_back());
+                }
+                else
+                {
+                    // a scalar is read aside, std::vector<bool> has no
+                    // reference to its elements
+                    Value value {};
+                    _BindElement(value);
+                    member.push_back(std::move(value));
+                }
+            }
+            else
+            {
+                _BindElement(member);
+            }
+        }
+
+        // a element no field want, with its subtree
+        void _Skip()
+        {
+            size_t depth = 0;
+            while (_status == XMLParser::NoError)
+            {
+                auto token = _Next();
+                if (token.type == XMLToken::StartElement)
+                {
+                    ++depth;
+                }
+                else if ((token.type == XMLToken::EndElement && depth-- == 0)
+                         || token.type == XMLToken::End)
+                {
+                    return;
+                }
+            }
+        }
+
+        template<typename T>
+        std::string &_TextBuffer(T &value) noexcept
+        {
+            if constexpr (std::is_same_v<T, std::string>)
+            {
+                return value;
+            }
+            else
+            {
+                return _text;
+            }
+        }
+
+        // a string field take the collected text itself
+        template<typename T>
+        void _Take(std::string &text, T &value)
+        {
+            if constexpr (std::is_same_v<T, std::string>)
+            {
+                value = std::move(text);
+            }
+            else
+            {
+                _Convert(text, value);
+            }
+        }
+
+        template<typename T>
+        void _Convert(std::string_view text, T &value)
+        {
+            if constexpr (std::is_same_v<T, std::string>)
+            {
+                value.assign(text);
+            }
+            else if (!XMLNode::FromText(text, value))
+            {
+                if (_status == XMLParser::NoError)
+                {
+                    _status = XMLParser::ValueConversionError;
+                    _errorIndex = _reader.Offset();
+                }
+            }
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_BINDER_HPP
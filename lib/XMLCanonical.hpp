@@ -0,0 +1,530 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_CANONICAL_HPP
+#define CRAFT_XML_CANONICAL_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    // incremental SHA-256, append the bytes in any pieces then Finish()
+    // append() is named like std::string's, so a sink of XMLCanonical can be
+    // a std::string or a Sha256
+    class Sha256
+    {
+    public:
+        using Digest = std::array<uint8_t, 32>;
+
+        void append(std::string_view data) noexcept
+        {
+            if (data.empty())
+            {
+                return;
+            }
+            _size += data.size();
+            if (_used != 0)
+            {
+                auto take = std::min(data.size(), _block.size() - _used);
+                std::memcpy(_block.data() + _used, data.data(), take);
+                _used += take;
+                data.remove_prefix(take);
+                if (_used < _block.size())
+                {
+                    return;
+                }
+                _Compress(_block.data());
+                _used = 0;
+            }
+            while (data.size() >= _block.size())
+            {
+                _Compress(reinterpret_cast<const uint8_t *>(data.data()));
+                data.remove_prefix(_block.size());
+            }
+            std::memcpy(_block.data(), data.data(), data.size());
+            _used = data.size();
+        }
+
+        // the hash of all appended bytes, the object is then spent
+        [[nodiscard]] Digest Finish() noexcept
+        {
+            uint64_t bits = _size * 8;
+            uint8_t pad = 0x80;
+            append({reinterpret_cast<const char *>(&pad), 1});
+            pad = 0;
+            while (_used != 56)
+            {
+                append({reinterpret_cast<const char *>(&pad), 1});
+            }
+            for (int shift = 56; shift >= 0; shift -= 8)
+            {
+                _block[_used++] = static_cast<uint8_t>(bits >> shift);
+            }
+            _Compress(_block.data());
+            Digest digest;
+            for (size_t i = 0; i < 8; ++i)
+            {
+                for (size_t k = 0; k < 4; ++k)
+                {
+                    digest[i * 4 + k] =
+                        static_cast<uint8_t>(_state[i] >> (24 - 8 * k));
+                }
+            }
+            return digest;
+        }
+
+        [[nodiscard]] static std::string Hex(const Digest &digest)
+        {
+            constexpr std::string_view digits = "0123456789abcdef";
+            std::string hex;
+            for (auto byte : digest)
+            {
+                hex.push_back(digits[byte >> 4]);
+                hex.push_back(digits[byte & 0xf]);
+            }
+            return hex;
+        }
+
+    private:
+        std::array<uint32_t, 8> _state = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                          0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                          0x1f83d9ab, 0x5be0cd19};
+
+        std::array<uint8_t, 64> _block {};
+
+        size_t _used = 0;
+
+        uint64_t _size = 0;
+
+        static constexpr uint32_t _Rotate(uint32_t x, int n) noexcept
+        {
+            return (x >> n) | (x << (32 - n));
+        }
+
+        void _Compress(const uint8_t *block) noexcept
+        {
+            static constexpr uint32_t k[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+                0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+                0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+                0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+                0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+                0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+                0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+                0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+                0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+                0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+                0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+                0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+            uint32_t w[64];
+            for (size_t i = 0; i < 16; ++i)
+            {
+                w[i] = uint32_t(block[i * 4]) << 24
+                       | uint32_t(block[i * 4 + 1]) << 16
+                       | uint32_t(block[i * 4 + 2]) << 8
+                       | uint32_t(block[i * 4 + 3]);
+            }
+            for (size_t i = 16; i < 64; ++i)
+            {
+                auto s0 = _Rotate(w[i - 15], 7) ^ _Rotate(w[i - 15], 18)
+                          ^ (w[i - 15] >> 3);
+                auto s1 = _Rotate(w[i - 2], 17) ^ _Rotate(w[i - 2], 19)
+                          ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            auto [a, b, c, d, e, f, g, h] = _state;
+            for (size_t i = 0; i < 64; ++i)
+            {
+                auto s1 = _Rotate(e, 6) ^ _Rotate(e, 11) ^ _Rotate(e, 25);
+                auto choose = (e & f) ^ (~e & g);
+                auto t1 = h + s1 + choose + k[i] + w[i];
+                auto s0 = _Rotate(a, 2) ^ _Rotate(a, 13) ^ _Rotate(a, 22);
+                auto majority = (a & b) ^ (a & c) ^ (b & c);
+                auto t2 = s0 + majority;
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            _state[0] += a;
+            _state[1] += b;
+            _state[2] += c;
+            _state[3] += d;
+            _state[4] += e;
+            _state[5] += f;
+            _state[6] += g;
+            _state[7] += h;
+        }
+    };
+
+    // Canonical XML 1.0 of a node, written piece by piece to a sink with
+    // append(std::string_view), nothing else is built, so the form can be
+    // hashed as it is made
+    //   elements always have a start and an end tag
+    //   namespace declarations come first, sorted by prefix, and only
+    //   where they change the binding in the output, the apex of a
+    //   subtree get the ones it inherit
+    //   attributes are sorted by namespace URI then local name
+    //   text escape & < > and CR, attribute values & < " TAB LF CR
+    //   comments are dropped unless WithComments, the declaration and
+    //   doctype always
+    // the tree is written as it is, so blanks dropped by the parser stay
+    // dropped, parse with ParsePreserveBlank to keep those of the input
+    class XMLCanonical
+    {
+    public:
+        static constexpr unsigned WithComments = 1;
+
+        template<typename Sink>
+        static void Write(const XMLNode &node, Sink &sink, unsigned options = 0)
+        {
+            Writer<Sink> writer {sink, options};
+            if (node.GetNodeType() == XMLNode::NodeDocument)
+            {
+                writer.Document(node);
+            }
+            else
+            {
+                writer.Inherit(node);
+                writer.Subtree(node);
+            }
+        }
+
+        [[nodiscard]] static std::string ToString(const XMLNode &node,
+                                                  unsigned options = 0)
+        {
+            std::string str;
+            Write(node, str, options);
+            return str;
+        }
+
+        // SHA-256 of the canonical form, streamed
+        [[nodiscard]] static Sha256::Digest Digest(const XMLNode &node,
+                                                   unsigned options = 0)
+        {
+            Sha256 sha;
+            Write(node, sha, options);
+            return sha.Finish();
+        }
+
+    private:
+        // views into the attributes of the tree being written
+        struct Binding
+        {
+            std::string_view prefix;
+            std::string_view uri;
+        };
+
+        struct Attribute
+        {
+            std::string_view uri;
+            std::string_view local;
+            std::string_view name;
+            std::string_view value;
+        };
+
+        template<typename Sink>
+        struct Writer
+        {
+            Sink &sink;
+            unsigned options;
+
+            // in scope of the input and in scope of the output
+            std::vector<Binding> declared {};
+            std::vector<Binding> rendered {};
+
+            // open elements, with their first binding in each scope
+            struct Frame
+            {
+                XMLNode element;
+                XMLNode next;
+                size_t declared;
+                size_t rendered;
+            };
+            std::vector<Frame> open {};
+
+            // reused by each element
+            std::vector<Binding> namespaces {};
+            std::vector<Attribute> attributes {};
+
+            // before the root element a node is followed by a LF, after it
+            // a node is preceded by one
+            void Document(const XMLNode &document)
+            {
+                bool afterRoot = false;
+                for (auto child : document.Children())
+                {
+                    auto type = child.GetNodeType();
+                    if (type == XMLNode::NodeElement)
+                    {
+                        Subtree(child);
+                        afterRoot = true;
+                    }
+                    else if (type == XMLNode::NodePI
+                             || (type == XMLNode::NodeComment
+                                 && (options & WithComments)))
+                    {
+                        if (afterRoot)
+                        {
+                            sink.append("\n");
+                        }
+                        Node(child, false);
+                        if (!afterRoot)
+                        {
+                            sink.append("\n");
+                        }
+                    }
+                }
+            }
+
+            // declarations of the ancestors of apex, the nearest last
+            void Inherit(const XMLNode &apex)
+            {
+                std::vector<XMLNode> ancestors;
+                for (auto ancestor : apex.Ancestors())
+                {
+                    ancestors.push_back(ancestor);
+                }
+                for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it)
+                {
+                    Declare(*it);
+                }
+            }
+
+            void Subtree(const XMLNode &apex)
+            {
+                Node(apex, true);
+                while (!open.empty())
+                {
+                    auto &frame = open.back();
+                    if (frame.next.IsEmpty())
+                    {
+                        End(frame);
+                        open.pop_back();
+                        continue;
+                    }
+                    auto child = frame.next;
+                    frame.next = child.NextSibling();
+                    Node(child, false);
+                }
+            }
+
+            void Node(const XMLNode &node, bool apex)
+            {
+                switch (node.GetNodeType())
+                {
+                    case XMLNode::NodeElement:
+                        Start(node, apex);
+                        break;
+                    case XMLNode::NodeData:
+                    case XMLNode::NodeCData:
+                        Text(node.GetNodeContent());
+                        break;
+                    case XMLNode::NodeComment:
+                        if (options & WithComments)
+                        {
+                            sink.append("<!--");
+                            sink.append(node.GetNodeContent());
+                            sink.append("-->");
+                        }
+                        break;
+                    case XMLNode::NodePI:
+                        sink.append("<?");
+                        sink.append(node.GetNodeTag());
+                        if (!node.GetNodeContent().empty())
+                        {
+                            sink.append(" ");
+                            sink.append(node.GetNodeContent());
+                        }
+                        sink.append("?>");
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            void Declare(const XMLNode &element)
+            {
+                for (auto &[name, value] : element.GetNodeAttributes())
+                {
+                    if (name == "xmlns")
+                    {
+                        declared.push_back({{}, value});
+                    }
+                    else if (name.starts_with("xmlns:"))
+                    {
+                        declared.push_back(
+                            {std::string_view(name).substr(6), value});
+                    }
+                }
+            }
+
+            static std::string_view Lookup(const std::vector<Binding> &scope,
+                                           std::string_view prefix)
+            {
+                for (auto it = scope.rbegin(); it != scope.rend(); ++it)
+                {
+                    if (it->prefix == prefix)
+                    {
+                        return it->uri;
+                    }
+                }
+                return prefix == "xml" ? XMLNames::XMLNamespace
+                                       : std::string_view();
+            }
+
+            void Start(const XMLNode &element, bool apex)
+            {
+                Frame frame {element, element.FirstChild(), declared.size(),
+                             rendered.size()};
+                Declare(element);
+
+                // the apex render every binding in scope, other elements
+                // only their own, when the output doesn't have it already
+                namespaces.clear();
+                for (auto i = declared.size(); i > (apex ? 0 : frame.declared);
+                     --i)
+                {
+                    auto &binding = declared[i - 1];
+                    auto seen = std::find_if(
+                        namespaces.begin(), namespaces.end(),
+                        [&](auto &b) { return b.prefix == binding.prefix; });
+                    if (seen == namespaces.end()
+                        && Lookup(rendered, binding.prefix) != binding.uri)
+                    {
+                        namespaces.push_back(binding);
+                    }
+                }
+                std::sort(namespaces.begin(), namespaces.end(),
+                          [](auto &a, auto &b) { return a.prefix < b.prefix; });
+                rendered.insert(rendered.end(), namespaces.begin(),
+                                namespaces.end());
+
+                attributes.clear();
+                for (auto &[name, value] : element.GetNodeAttributes())
+                {
+                    std::string_view qualified = name;
+                    if (qualified == "xmlns" || qualified.starts_with("xmlns:"))
+                    {
+                        continue;
+                    }
+                    auto colon = qualified.find(':');
+                    if (colon == std::string_view::npos)
+                    {
+                        attributes.push_back({{}, qualified, qualified, value});
+                    }
+                    else
+                    {
+                        attributes.push_back(
+                            {Lookup(declared, qualified.substr(0, colon)),
+                             qualified.substr(colon + 1), qualified, value});
+                    }
+                }
+                std::sort(attributes.begin(), attributes.end(),
+                          [](auto &a, auto &b) {
+                              return a.uri != b.uri ? a.uri < b.uri
+                                                    : a.local < b.local;
+                          });
+
+                sink.append("<");
+                sink.append(element.GetNodeTag());
+                for (auto &binding : namespaces)
+                {
+                    sink.append(binding.prefix.empty() ? " xmlns" : " xmlns:");
+                    sink.append(binding.prefix);
+                    sink.append("=\"");
+                    Value(binding.uri);
+                    sink.append("\"");
+                }
+                for (auto &attribute : attributes)
+                {
+                    sink.append(" ");
+                    sink.append(attribute.name);
+                    sink.append("=\"");
+                    Value(attribute.value);
+                    sink.append("\"");
+                }
+                sink.append(">");
+
+                // a text kept in the element by ParseTextInParent
+                if (frame.next.IsEmpty())
+                {
+                    Text(element.GetNodeContent());
+                }
+                open.push_back(frame);
+            }
+
+            void End(const Frame &frame)
+            {
+                sink.append("</");
+                sink.append(frame.element.GetNodeTag());
+                sink.append(">");
+                declared.resize(frame.declared);
+                rendered.resize(frame.rendered);
+            }
+
+            void Text(std::string_view text)
+            {
+                Escape(text, [](char c) -> std::string_view {
+                    switch (c)
+                    {
+                        case '&': return "&amp;";
+                        case '<': return "&lt;";
+                        case '>': return "&gt;";
+                        case '\r': return "&#xD;";
+                        default: return {};
+                    }
+                });
+            }
+
+            void Value(std::string_view value)
+            {
+                Escape(value, [](char c) -> std::string_view {
+                    switch (c)
+                    {
+                        case '&': return "&amp;";
+                        case '<': return "&lt;";
+                        case '"': return "&quot;";
+                        case '\t': return "&#x9;";
+                        case '\n': return "&#xA;";
+                        case '\r': return "&#xD;";
+                        default: return {};
+                    }
+                });
+            }
+
+            // runs without a char to escape are appended whole
+            template<typename Replace>
+            void Escape(std::string_view str, Replace replace)
+            {
+                size_t first = 0;
+                for (size_t i = 0; i < str.size(); ++i)
+                {
+                    auto replacement = replace(str[i]);
+                    if (!replacement.empty())
+                    {
+                        sink.append(str.substr(first, i - first));
+                        sink.append(replacement);
+                        first = i + 1;
+                    }
+                }
+                sink.append(str.substr(first));
+            }
+        };
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_CANONICAL_HPP
@@ -0,0 +1,488 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_DIFF_HPP
+#define CRAFT_XML_DIFF_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    // edit script from one document to another, made by Compare and
+    // applied in place by Apply, so a new version of a large document can
+    // be taken without parsing and building it again
+    // subtrees are compared by hash, a equal subtree cost one comparison
+    // and is skipped, only the changed paths are walked
+    // the script moves a cursor over the children of a element:
+    //   EditSkip        pass count children
+    //   EditRemove      remove count children
+    //   EditInsert      insert a copy of node before the cursor
+    //   EditEnter       go into the child at the cursor
+    //   EditLeave       go back to the parent, past the child
+    //   EditSetContent, EditSetAttribute, EditRemoveAttribute
+    //                   change the element entered last
+    // a moved subtree is removed and inserted again
+    class XMLDiff
+    {
+    public:
+        enum EditKind
+        {
+            EditSkip,
+            EditRemove,
+            EditInsert,
+            EditEnter,
+            EditLeave,
+            EditSetContent,
+            EditSetAttribute,
+            EditRemoveAttribute
+        };
+
+        struct Edit
+        {
+            EditKind kind;
+            // of EditSkip and EditRemove
+            size_t count = 0;
+            // attribute name
+            std::string name {};
+            // content or attribute value
+            std::string value {};
+            // subtree of EditInsert, owned by the diff
+            XMLNode node = XMLNode::_Null();
+        };
+
+        XMLDiff(XMLDiff &&other) noexcept : _edits(std::move(other._edits))
+        {
+            other._edits.clear();
+        }
+
+        XMLDiff(const XMLDiff &) = delete;
+
+        XMLDiff &operator=(const XMLDiff &) = delete;
+
+        ~XMLDiff()
+        {
+            for (auto &edit : _edits)
+            {
+                if (edit.kind == EditInsert)
+                {
+                    XMLNode::_FreeTree(edit.node._node);
+                }
+            }
+        }
+
+        // the edits which turn from into to, both are only read
+        [[nodiscard]] static XMLDiff Compare(const XMLDocument &from,
+                                             const XMLDocument &to)
+        {
+            XMLDiff diff;
+            auto fromTree = _Index(from._node);
+            auto toTree = _Index(to._node);
+            if (fromTree.hashes[0] == toTree.hashes[0])
+            {
+                return diff;
+            }
+            diff._Fields(from._node, to._node);
+            // one frame per entered element, so deep trees don't recurse
+            struct Frame
+            {
+                std::vector<Step> steps;
+                size_t next = 0;
+            };
+            std::vector<Frame> open;
+            open.push_back(
+                {_Align({from._node, 0}, fromTree, {to._node, 0}, toTree)});
+            size_t skip = 0;
+            while (!open.empty())
+            {
+                if (open.back().next == open.back().steps.size())
+                {
+                    // the cursor is set back by EditLeave, no need to skip
+                    // the children left
+                    skip = 0;
+                    open.pop_back();
+                    if (!open.empty())
+                    {
+                        diff._edits.push_back({EditLeave});
+                    }
+                    continue;
+                }
+                auto step = open.back().steps[open.back().next++];
+                if (step.kind == EditSkip)
+                {
+                    skip += step.count;
+                    continue;
+                }
+                if (skip != 0)
+                {
+                    diff._edits.push_back({EditSkip, skip});
+                    skip = 0;
+                }
+                switch (step.kind)
+                {
+                    case EditRemove:
+                        if (!diff._edits.empty()
+                            && diff._edits.back().kind == EditRemove)
+                        {
+                            ++diff._edits.back().count;
+                        }
+                        else
+                        {
+                            diff._edits.push_back({EditRemove, 1});
+                        }
+                        break;
+                    case EditInsert:
+                        diff._edits.push_back(
+                            {EditInsert, 0, {}, {},
+                             XMLNode(XMLNode::_CloneTree(step.to.node))});
+                        break;
+                    default:
+                        diff._edits.push_back({EditEnter});
+                        diff._Fields(step.from.node, step.to.node);
+                        open.push_back({_Align(step.from, fromTree, step.to,
+                                               toTree)});
+                        break;
+                }
+            }
+            // the script end where the cursor is
+            while (!diff._edits.empty() && diff._edits.back().kind == EditLeave)
+            {
+                diff._edits.pop_back();
+            }
+            return diff;
+        }
+
+        // document must equal the from document of Compare, it then equal
+        // the to document
+        // return false if the script doesn't fit the document, which may
+        // then be partly changed, or if it is frozen
+        bool Apply(XMLDocument &document) const
+        {
+            if (document.IsFrozen())
+            {
+                return false;
+            }
+            std::vector<std::pair<NodeStruct *, NodeStruct *>> open;
+            auto *parent = document._node;
+            auto *cursor = parent->_firstChild;
+            for (auto &edit : _edits)
+            {
+                XMLNode element(parent);
+                switch (edit.kind)
+                {
+                    case EditSkip:
+                        for (size_t n = 0; n < edit.count; ++n)
+                        {
+                            if (cursor == parent->_lastChild)
+                            {
+                                return false;
+                            }
+                            cursor = cursor->_next;
+                        }
+                        break;
+                    case EditRemove:
+                        for (size_t n = 0; n < edit.count; ++n)
+                        {
+                            if (cursor == parent->_lastChild)
+                            {
+                                return false;
+                            }
+                            XMLNode child(cursor);
+                            cursor = cursor->_next;
+                            element.RemoveChild(child);
+                        }
+                        break;
+                    case EditInsert:
+                    {
+                        auto copy = edit.node.Clone();
+                        element._Insert(copy, cursor);
+                        break;
+                    }
+                    case EditEnter:
+                        if (cursor == parent->_lastChild)
+                        {
+                            return false;
+                        }
+                        open.emplace_back(parent, cursor);
+                        parent = cursor;
+                        cursor = parent->_firstChild;
+                        break;
+                    case EditLeave:
+                        if (open.empty())
+                        {
+                            return false;
+                        }
+                        parent = open.back().first;
+                        cursor = open.back().second->_next;
+                        open.pop_back();
+                        break;
+                    case EditSetContent:
+                        element.SetNodeContent(edit.value);
+                        break;
+                    case EditSetAttribute:
+                        element.AddNodeAttribute(edit.name, edit.value);
+                        break;
+                    case EditRemoveAttribute:
+                        element.RemoveNodeAttribute(edit.name);
+                        break;
+                }
+            }
+            return true;
+        }
+
+        [[nodiscard]] const std::vector<Edit> &Edits() const noexcept
+        {
+            return _edits;
+        }
+
+        // the documents were equal
+        [[nodiscard]] bool Empty() const noexcept { return _edits.empty(); }
+
+    private:
+        using NodeStruct = XMLNode::XMLNodeStruct;
+
+        std::vector<Edit> _edits;
+
+        XMLDiff() = default;
+
+        // subtree hash and size of each node, by preorder index
+        struct Tree
+        {
+            std::vector<uint64_t> hashes;
+            std::vector<uint32_t> sizes;
+        };
+
+        struct Child
+        {
+            NodeStruct *node;
+            size_t index;
+        };
+
+        // how a child of from become one of to, EditSkip for count equal
+        // children, EditEnter for a changed one, EditRemove and EditInsert
+        struct Step
+        {
+            EditKind kind;
+            Child from;
+            Child to;
+            size_t count = 1;
+        };
+
+        // one walk, a node is hashed with its fields, then the count and
+        // the hash of its children, which are mixed apart from another
+        // seed, so a parent and its only child don't hash the same swapped
+        static Tree _Index(NodeStruct *root)
+        {
+            constexpr uint64_t childrenSeed = 0x9e3779b97f4a7c15ULL;
+            struct Open
+            {
+                size_t index;
+                uint64_t children = childrenSeed;
+                uint64_t count = 0;
+            };
+            auto close = [](uint64_t &hash, const Open &open) {
+                XMLNode::_Mix(hash, open.count);
+                XMLNode::_Mix(hash, open.children);
+            };
+            Tree tree;
+            std::vector<Open> open;
+            auto *node = root;
+            while (true)
+            {
+                auto index = tree.hashes.size();
+                uint64_t hash = XMLNode::_HashSeed;
+                XMLNode::_MixFields(hash, node);
+                tree.hashes.push_back(hash);
+                tree.sizes.push_back(1);
+                if (node->_firstChild != node->_lastChild)
+                {
+                    open.push_back({index});
+                    node = node->_firstChild;
+                    continue;
+                }
+                close(tree.hashes[index], {index});
+                // close node and each ancestor it is the last node of
+                while (!open.empty())
+                {
+                    auto &parent = open.back();
+                    XMLNode::_Mix(parent.children, tree.hashes[index]);
+                    ++parent.count;
+                    if (node->_next != node->_parent->_lastChild)
+                    {
+                        node = node->_next;
+                        break;
+                    }
+                    index = parent.index;
+                    tree.sizes[index] =
+                        static_cast<uint32_t>(tree.hashes.size() - index);
+                    close(tree.hashes[index], parent);
+                    open.pop_back();
+                    node = node->_parent;
+                }
+                if (open.empty())
+                {
+                    return tree;
+                }
+            }
+        }
+
+        static std::vector<Child> _Children(Child parent, const Tree &tree)
+        {
+            std::vector<Child> children;
+            auto index = parent.index + 1;
+            for (auto *child = parent.node->_firstChild;
+                 child != parent.node->_lastChild; child = child->_next)
+            {
+                children.push_back({child, index});
+                index += tree.sizes[index];
+            }
+            return children;
+        }
+
+        // children of from and to line up, equal subtrees first: the
+        // common head and tail, then each child of to take the next equal
+        // one of from, those left between two equal pairs are paired in
+        // order when they have the same type and tag, else removed or
+        // inserted
+        static std::vector<Step> _Align(Child from, const Tree &fromTree,
+                                        Child to, const Tree &toTree)
+        {
+            auto a = _Children(from, fromTree);
+            auto b = _Children(to, toTree);
+            auto equal = [&](size_t i, size_t j) {
+                return fromTree.hashes[a[i].index] == toTree.hashes[b[j].index];
+            };
+            size_t head = 0;
+            while (head < a.size() && head < b.size() && equal(head, head))
+            {
+                ++head;
+            }
+            size_t tail = 0;
+            while (tail < a.size() - head && tail < b.size() - head
+                   && equal(a.size() - 1 - tail, b.size() - 1 - tail))
+            {
+                ++tail;
+            }
+
+            std::vector<Step> steps;
+            if (head != 0)
+            {
+                steps.push_back({EditSkip, {}, {}, head});
+            }
+            // positions in a of each hash of the middle, in order
+            std::unordered_map<uint64_t, std::vector<size_t>> positions;
+            for (auto i = head; i < a.size() - tail; ++i)
+            {
+                positions[fromTree.hashes[a[i].index]].push_back(i);
+            }
+            std::unordered_map<uint64_t, size_t> used;
+            auto same = [&](size_t i, size_t j) {
+                return a[i].node->_type == b[j].node->_type
+                       && a[i].node->_tag == b[j].node->_tag;
+            };
+            auto i = head;
+            auto j = head;
+            // pair a[i, aEnd) with b[j, bEnd), a child inserted or removed
+            // before a pair is seen one child ahead
+            auto pair = [&](size_t aEnd, size_t bEnd) {
+                while (i < aEnd || j < bEnd)
+                {
+                    if (i < aEnd && j < bEnd && same(i, j))
+                    {
+                        steps.push_back(
+                            {equal(i, j) ? EditSkip : EditEnter, a[i], b[j]});
+                        ++i;
+                        ++j;
+                    }
+                    else if (i < aEnd && j + 1 < bEnd && same(i, j + 1))
+                    {
+                        steps.push_back({EditInsert, {}, b[j]});
+                        ++j;
+                    }
+                    else if (i < aEnd && (aEnd - i >= bEnd - j
+                                          || (i + 1 < aEnd && j < bEnd
+                                              && same(i + 1, j))))
+                    {
+                        steps.push_back({EditRemove, a[i], {}});
+                        ++i;
+                    }
+                    else
+                    {
+                        steps.push_back({EditInsert, {}, b[j]});
+                        ++j;
+                    }
+                }
+            };
+            for (auto k = head; k < b.size() - tail; ++k)
+            {
+                auto it = positions.find(toTree.hashes[b[k].index]);
+                if (it == positions.end())
+                {
+                    continue;
+                }
+                auto &next = used[it->first];
+                while (next < it->second.size() && it->second[next] < i)
+                {
+                    ++next;
+                }
+                if (next == it->second.size())
+                {
+                    continue;
+                }
+                pair(it->second[next++], k);
+                steps.push_back({EditSkip, a[i], b[j]});
+                ++i;
+                ++j;
+            }
+            pair(a.size() - tail, b.size() - tail);
+            if (tail != 0)
+            {
+                steps.push_back({EditSkip, {}, {}, tail});
+            }
+            return steps;
+        }
+
+        // content and attributes of the entered element
+        void _Fields(const NodeStruct *from, const NodeStruct *to)
+        {
+            if (from->_content != to->_content)
+            {
+                _edits.push_back({EditSetContent, 0, {}, to->_content});
+            }
+            auto a = from->_attributes.begin();
+            auto b = to->_attributes.begin();
+            while (a != from->_attributes.end() || b != to->_attributes.end())
+            {
+                if (b == to->_attributes.end()
+                    || (a != from->_attributes.end() && a->first < b->first))
+                {
+                    _edits.push_back({EditRemoveAttribute, 0, a->first});
+                    ++a;
+                }
+                else if (a == from->_attributes.end() || b->first < a->first)
+                {
+                    _edits.push_back(
+                        {EditSetAttribute, 0, b->first, b->second});
+                    ++b;
+                }
+                else
+                {
+                    if (a->second != b->second)
+                    {
+                        _edits.push_back(
+                            {EditSetAttribute, 0, b->first, b->second});
+                    }
+                    ++a;
+                    ++b;
+                }
+            }
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_DIFF_HPP
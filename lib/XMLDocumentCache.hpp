@@ -0,0 +1,323 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_DOCUMENT_CACHE_HPP
+#define CRAFT_XML_DOCUMENT_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __unix__
+    #include <sys/stat.h>
+#endif
+
+#include "CraftXML.hpp"
+#include "XMLSnapshot.hpp"
+
+namespace Craft
+{
+    // parsed documents shared by file name, a load of a file which didn't
+    // change cost a stat, the documents are frozen and shared by every
+    // caller, so any number of threads can read them at once
+    // a file is unchanged when its device, inode, size and mtime are (size
+    // and mtime where there is no inode), a file touched with the same
+    // bytes is found by the hash of its contents and not parsed again
+    // documents are dropped from the least recently used while their
+    // estimated size is over the budget, one still held by a caller stay
+    // alive until it is released, its nodes then go back to the node pool
+    // of the releasing thread
+    class XMLDocumentCache
+    {
+    public:
+        struct Statistics
+        {
+            // unchanged file, a stat
+            size_t hits = 0;
+            // changed file with the same contents, a read and a hash
+            size_t revalidations = 0;
+            // parsed, first load or new contents
+            size_t misses = 0;
+            size_t evictions = 0;
+            size_t documents = 0;
+            size_t bytes = 0;
+        };
+
+        explicit XMLDocumentCache(size_t budget,
+                                  unsigned parseFlag = XMLParser::ParseFull) :
+            _budget(budget), _parseFlag(parseFlag)
+        {
+        }
+
+        XMLDocumentCache(const XMLDocumentCache &) = delete;
+
+        XMLDocumentCache &operator=(const XMLDocumentCache &) = delete;
+
+        // also indexed in the documents parsed after it, see
+        // XMLDocument::SetIndexedAttributes
+        void SetIndexedAttributes(std::vector<std::string> names)
+        {
+            std::lock_guard lock(_mutex);
+            _indexed = std::move(names);
+        }
+
+        // nullptr if the file can't be read or parsed, status tell why
+        std::shared_ptr<const XMLDocument> Load(const std::string &fileName,
+                                                XMLParser::ParseStatus &status)
+        {
+            status = XMLParser::NoError;
+            FileIdentity identity;
+            if (!_Identify(fileName, identity))
+            {
+                status = XMLParser::FileOpenFailed;
+                return nullptr;
+            }
+            uint64_t checksum = 0;
+            bool cached = false;
+            std::vector<std::string> indexed;
+            {
+                std::lock_guard lock(_mutex);
+                if (auto it = _entries.find(fileName); it != _entries.end())
+                {
+                    auto &entry = it->second;
+                    _lru.splice(_lru.begin(), _lru, entry.position);
+                    if (entry.identity == identity)
+                    {
+                        ++_statistics.hits;
+                        return entry.document;
+                    }
+                    checksum = entry.checksum;
+                    cached = true;
+                }
+                indexed = _indexed;
+            }
+
+            // read and parse without the lock, other files stay available
+            std::ifstream file(fileName, std::ios::in | std::ios::binary);
+            if (!file.is_open())
+            {
+                status = XMLParser::FileOpenFailed;
+                return nullptr;
+            }
+            std::string contents((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+            auto newChecksum = XMLSnapshot::Checksum(contents);
+            if (cached && newChecksum == checksum)
+            {
+                std::lock_guard lock(_mutex);
+                if (auto it = _entries.find(fileName); it != _entries.end()
+                    && it->second.checksum == newChecksum)
+                {
+                    it->second.identity = identity;
+                    ++_statistics.revalidations;
+                    return it->second.document;
+                }
+            }
+
+            auto document = _MakeDocument();
+            if (!indexed.empty())
+            {
+                document->SetIndexedAttributes(indexed);
+            }
+            auto result = document->LoadString(contents, _parseFlag);
+            if (result._status != XMLParser::NoError)
+            {
+                status = result._status;
+                return nullptr;
+            }
+            document->Freeze();
+            auto bytes = _Footprint(*document);
+
+            // released after the lock, freeing a tree can take a while
+            std::vector<std::shared_ptr<const XMLDocument>> dropped;
+            std::lock_guard lock(_mutex);
+            ++_statistics.misses;
+            if (auto it = _entries.find(fileName); it != _entries.end())
+            {
+                dropped.push_back(_Drop(it));
+            }
+            _lru.push_front(fileName);
+            _entries.emplace(fileName, Entry {document, identity, newChecksum,
+                                              bytes, _lru.begin()});
+            _statistics.bytes += bytes;
+            ++_statistics.documents;
+            // the new document is kept even alone over the budget
+            while (_statistics.bytes > _budget && _lru.size() > 1)
+            {
+                dropped.push_back(_Drop(_entries.find(_lru.back())));
+                ++_statistics.evictions;
+            }
+            return document;
+        }
+
+        std::shared_ptr<const XMLDocument> Load(const std::string &fileName)
+        {
+            XMLParser::ParseStatus status;
+            return Load(fileName, status);
+        }
+
+        // the next load of fileName parse it again
+        void Erase(const std::string &fileName)
+        {
+            std::shared_ptr<const XMLDocument> dropped;
+            std::lock_guard lock(_mutex);
+            if (auto it = _entries.find(fileName); it != _entries.end())
+            {
+                dropped = _Drop(it);
+            }
+        }
+
+        void Clear()
+        {
+            std::unordered_map<std::string, Entry> dropped;
+            std::lock_guard lock(_mutex);
+            dropped.swap(_entries);
+            _lru.clear();
+            _statistics.documents = 0;
+            _statistics.bytes = 0;
+        }
+
+        [[nodiscard]] Statistics GetStatistics() const
+        {
+            std::lock_guard lock(_mutex);
+            return _statistics;
+        }
+
+    private:
+        struct FileIdentity
+        {
+            uint64_t device = 0;
+            uint64_t inode = 0;
+            uint64_t size = 0;
+            int64_t modified = 0;
+
+            bool operator==(const FileIdentity &) const = default;
+        };
+
+        struct Entry
+        {
+            std::shared_ptr<const XMLDocument> document;
+            FileIdentity identity;
+            uint64_t checksum;
+            size_t bytes;
+            std::list<std::string>::iterator position;
+        };
+
+        size_t _budget;
+
+        unsigned _parseFlag;
+
+        std::vector<std::string> _indexed;
+
+        mutable std::mutex _mutex;
+
+        // file names, the most recently used first
+        std::list<std::string> _lru;
+
+        std::unordered_map<std::string, Entry> _entries;
+
+        Statistics _statistics;
+
+        static bool _Identify(const std::string &fileName,
+                              FileIdentity &identity)
+        {
+#ifdef __unix__
+            struct stat info;
+            if (stat(fileName.c_str(), &info) != 0)
+            {
+                return false;
+            }
+            identity.device = static_cast<uint64_t>(info.st_dev);
+            identity.inode = static_cast<uint64_t>(info.st_ino);
+            identity.size = static_cast<uint64_t>(info.st_size);
+    #ifdef __linux__
+            identity.modified =
+                static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000
+                + info.st_mtim.tv_nsec;
+    #else
+            identity.modified = static_cast<int64_t>(info.st_mtime);
+    #endif
+            return true;
+#else
+            std::error_code error;
+            auto size = std::filesystem::file_size(fileName, error);
+            if (error)
+            {
+                return false;
+            }
+            auto modified = std::filesystem::last_write_time(fileName, error);
+            if (error)
+            {
+                return false;
+            }
+            identity.size = size;
+            identity.modified = modified.time_since_epoch().count();
+            return true;
+#endif
+        }
+
+        // a XMLDocument never free its tree, the cache own it, the last
+        // holder give it back
+        static std::shared_ptr<XMLDocument> _MakeDocument()
+        {
+            std::shared_ptr<XMLDocument> document(
+                new XMLDocument(), [](XMLDocument *document) {
+                    XMLNode::_FreeTree(document->_node);
+                    delete document;
+                });
+            // the load then free the node made by the constructor too
+            document->Clear();
+            return document;
+        }
+
+        // called with the lock held, the document is released by the
+        // caller once it is unlocked
+        std::shared_ptr<const XMLDocument>
+        _Drop(std::unordered_map<std::string, Entry>::iterator it)
+        {
+            auto document = std::move(it->second.document);
+            _statistics.bytes -= it->second.bytes;
+            --_statistics.documents;
+            _lru.erase(it->second.position);
+            _entries.erase(it);
+            return document;
+        }
+
+        // estimated heap size of a parsed document, each node and its
+        // sentinel, the strings out of their inline buffer and the
+        // attribute map nodes
+        static size_t _Footprint(const XMLDocument &document)
+        {
+            using NodeStruct = XMLNode::XMLNodeStruct;
+            constexpr size_t mapNode = 4 * sizeof(void *);
+            auto heap = [](const std::string &str) {
+                return str.capacity() > std::string().capacity()
+                           ? str.capacity() + 1
+                           : 0;
+            };
+            size_t bytes = sizeof(XMLDocument);
+            for (NodeStruct *node = document._node; node != nullptr;
+                 node = XMLNode::_NextPreorder(node, document._node))
+            {
+                bytes += 2 * sizeof(NodeStruct) + heap(node->_tag)
+                         + heap(node->_content);
+                for (auto &[name, value] : node->_attributes)
+                {
+                    bytes += mapNode + sizeof(name) + sizeof(value)
+                             + heap(name) + heap(value);
+                }
+            }
+            return bytes;
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_DOCUMENT_CACHE_HPP
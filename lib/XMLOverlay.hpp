@@ -0,0 +1,325 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_OVERLAY_HPP
+#define CRAFT_XML_OVERLAY_HPP
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    // per request changes on top of a shared base document, the base is
+    // never written and unchanged nodes are read from it, so a overlay
+    // cost memory only for what it change
+    // nodes have a parent link and their siblings are linked in place, so
+    // a changed path can't be copied and share the rest, the changes are
+    // kept beside the base instead and read through Node
+    // the base must outlive the overlay and not change while it is used,
+    // any number of overlays can read it at once
+    class XMLOverlay
+    {
+        struct Change;
+
+    public:
+        // view of a node of the base with the changes of the overlay, or of
+        // a node added by the overlay
+        class Node
+        {
+        public:
+            Node() = default;
+
+            [[nodiscard]] bool IsEmpty() const noexcept
+            {
+                return _node == nullptr;
+            }
+
+            [[nodiscard]] const std::string &GetNodeTag() const noexcept
+            {
+                return _node->_tag;
+            }
+
+            [[nodiscard]] XMLNode::NodeType GetNodeType() const noexcept
+            {
+                return _node->_type;
+            }
+
+            [[nodiscard]] const std::string &GetNodeContent() const
+            {
+                if (auto *change = _Change();
+                    change != nullptr && change->content)
+                {
+                    return *change->content;
+                }
+                return _node->_content;
+            }
+
+            // empty string if node don't have the attribute
+            [[nodiscard]] const std::string &
+            GetNodeAttribute(std::string_view attributeName) const
+            {
+                if (auto *change = _Change(); change != nullptr)
+                {
+                    if (auto it = change->attributes.find(attributeName);
+                        it != change->attributes.end())
+                    {
+                        return it->second;
+                    }
+                }
+                auto it = _node->_attributes.find(attributeName);
+                return it != _node->_attributes.end() ? it->second
+                                                      : EmptyString;
+            }
+
+            [[nodiscard]] bool
+            HasNodeAttribute(std::string_view attributeName) const
+            {
+                auto *change = _Change();
+                return (change != nullptr
+                        && change->attributes.find(attributeName)
+                               != change->attributes.end())
+                       || _node->_attributes.find(attributeName)
+                              != _node->_attributes.end();
+            }
+
+            // a merged copy
+            [[nodiscard]] XMLNode::Attributes GetNodeAttributes() const
+            {
+                auto attributes = _node->_attributes;
+                if (auto *change = _Change(); change != nullptr)
+                {
+                    for (auto &[name, value] : change->attributes)
+                    {
+                        attributes.insert_or_assign(name, value);
+                    }
+                }
+                return attributes;
+            }
+
+            // children of the base, then the added ones
+            [[nodiscard]] std::vector<Node> Children() const
+            {
+                std::vector<Node> children;
+                for (auto *child = _node->_firstChild;
+                     child != _node->_lastChild; child = child->_next)
+                {
+                    children.push_back(Node(_overlay, child, _shared));
+                }
+                if (auto *change = _Change(); change != nullptr)
+                {
+                    for (auto *child : change->children)
+                    {
+                        children.push_back(Node(_overlay, child, false));
+                    }
+                }
+                return children;
+            }
+
+            [[nodiscard]] Node
+            FindFirstChildByTagName(std::string_view tagName) const
+            {
+                for (auto *child = _node->_firstChild;
+                     child != _node->_lastChild; child = child->_next)
+                {
+                    if (child->_tag == tagName)
+                    {
+                        return Node(_overlay, child, _shared);
+                    }
+                }
+                if (auto *change = _Change(); change != nullptr)
+                {
+                    for (auto *child : change->children)
+                    {
+                        if (child->_tag == tagName)
+                        {
+                            return Node(_overlay, child, false);
+                        }
+                    }
+                }
+                return Node();
+            }
+
+            // a node added by the overlay is changed in place
+            void SetNodeContent(std::string content)
+            {
+                if (_shared)
+                {
+                    _overlay->_changes[_node].content = std::move(content);
+                }
+                else
+                {
+                    XMLNode(_node).SetNodeContent(std::move(content));
+                }
+            }
+
+            void AddNodeAttribute(const std::string &name,
+                                  const std::string &value)
+            {
+                if (_shared)
+                {
+                    _overlay->_changes[_node].attributes.insert_or_assign(
+                        name, value);
+                }
+                else
+                {
+                    XMLNode(_node).AddNodeAttribute(name, value);
+                }
+            }
+
+            // child is taken by the overlay, detached from its parent, and
+            // given back to the node pool with the overlay
+            // return the view of child
+            Node AddChild(XMLNode &child)
+            {
+                if (_shared)
+                {
+                    child.Detach();
+                    _overlay->_changes[_node].children.push_back(child._node);
+                }
+                else
+                {
+                    XMLNode(_node).AddChild(child);
+                }
+                return Node(_overlay, child._node, false);
+            }
+
+        private:
+            friend class XMLOverlay;
+
+            using NodeStruct = XMLNode::XMLNodeStruct;
+
+            inline static const std::string EmptyString;
+
+            XMLOverlay *_overlay = nullptr;
+
+            NodeStruct *_node = nullptr;
+
+            // node of the base, only changed through the overlay
+            bool _shared = false;
+
+            Node(XMLOverlay *overlay, NodeStruct *node, bool shared) :
+                _overlay(overlay), _node(node), _shared(shared)
+            {
+            }
+
+            const Change *_Change() const
+            {
+                if (!_shared)
+                {
+                    return nullptr;
+                }
+                auto it = _overlay->_changes.find(_node);
+                return it != _overlay->_changes.end() ? &it->second : nullptr;
+            }
+        };
+
+        explicit XMLOverlay(const XMLDocument &base) : _base(base._node) {}
+
+        XMLOverlay(const XMLOverlay &) = delete;
+
+        XMLOverlay &operator=(const XMLOverlay &) = delete;
+
+        ~XMLOverlay()
+        {
+            for (auto &[node, change] : _changes)
+            {
+                for (auto *child : change.children)
+                {
+                    XMLNode::_FreeTree(child);
+                }
+            }
+        }
+
+        // the document node
+        [[nodiscard]] Node Root() noexcept { return Node(this, _base, true); }
+
+        // nodes of the base which have a change
+        [[nodiscard]] size_t ChangedNodes() const noexcept
+        {
+            return _changes.size();
+        }
+
+        // append a copy of the base with the changes to document, like
+        // XMLDocument::Import(base)
+        void CopyTo(XMLDocument &document) const
+        {
+            for (auto *child = _base->_firstChild; child != _base->_lastChild;
+                 child = child->_next)
+            {
+                auto copy = document.Import(XMLNode(child));
+                // the copy has the shape of child, walk both at once
+                auto *source = child;
+                auto *target = copy._node;
+                std::vector<std::pair<const NodeStruct *, NodeStruct *>>
+                    changed;
+                while (source != nullptr)
+                {
+                    if (_changes.find(source) != _changes.end())
+                    {
+                        changed.emplace_back(source, target);
+                    }
+                    source = XMLNode::_NextPreorder(source, child);
+                    target = XMLNode::_NextPreorder(target, copy._node);
+                }
+                for (auto [from, to] : changed)
+                {
+                    _Apply(from, to);
+                }
+            }
+            // children added to the document come after the base ones, as
+            // in Children()
+            _Apply(_base, document._node);
+        }
+
+    private:
+        using NodeStruct = XMLNode::XMLNodeStruct;
+
+        struct Change
+        {
+            std::optional<std::string> content;
+
+            // added or replaced
+            XMLNode::Attributes attributes;
+
+            // added after the children of the base, owned by the overlay
+            std::vector<NodeStruct *> children;
+        };
+
+        NodeStruct *_base;
+
+        std::unordered_map<const NodeStruct *, Change> _changes;
+
+        // write the change of source, if any, to target
+        void _Apply(const NodeStruct *source, NodeStruct *target) const
+        {
+            auto it = _changes.find(source);
+            if (it == _changes.end())
+            {
+                return;
+            }
+            auto &change = it->second;
+            XMLNode node(target);
+            if (change.content)
+            {
+                node.SetNodeContent(*change.content);
+            }
+            for (auto &[name, value] : change.attributes)
+            {
+                node.AddNodeAttribute(name, value);
+            }
+            for (auto *child : change.children)
+            {
+                auto copy = XMLNode(child).Clone();
+                node.AddChild(copy);
+            }
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_OVERLAY_HPP
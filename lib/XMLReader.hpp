@@ -0,0 +1,644 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_READER_HPP
+#define CRAFT_XML_READER_HPP
+
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    struct XMLToken
+    {
+        enum Type
+        {
+            // no more token, the document is over
+            End,
+            // Feed more input, or Finish it
+            NeedInput,
+            // see XMLReader::Status
+            Error,
+            StartElement,
+            EndElement,
+            Text,
+            CData,
+            Comment,
+            PI,
+            Declaration,
+            Doctype
+        };
+
+        Type type = End;
+
+        // tag of element, target of PI
+        std::string_view name {};
+
+        // text, CDATA, comment, PI or doctype content
+        std::string_view value {};
+    };
+
+    // pull parser, Next() return one token at a time, it run the grammar of
+    // XMLParser in a coroutine which suspend after every construct
+    // payloads are views, valid until the next call of Next or Feed
+    // memory is the open tags and the construct being read, whatever the
+    // size of document
+    //
+    //     XMLReader reader(text);
+    //     for (auto token = reader.Next(); token.type > XMLToken::Error;
+    //          token = reader.Next())
+    //
+    // a reader made without input is fed in chunks, Next() return
+    // NeedInput until the construct it is at is complete, Finish() tell
+    // there is nothing more, chunked input must be UTF-8
+    // a exception thrown while reading (bad_alloc, ...) leave Next(), the
+    // reader is then over and Next() return Error
+    class XMLReader
+    {
+    public:
+        struct Attribute
+        {
+            std::string_view name;
+            std::string_view value;
+        };
+
+        explicit XMLReader(std::string_view contents,
+                           unsigned parseFlag = XMLParser::ParseFull) :
+            XMLReader(parseFlag)
+        {
+            _input = contents;
+            _whole = true;
+            _finished = true;
+        }
+
+        explicit XMLReader(unsigned parseFlag = XMLParser::ParseFull) :
+            _handler(*this), _routine(_Run())
+        {
+            _parser._parseFlag = parseFlag;
+        }
+
+        // the coroutine point to this reader
+        XMLReader(const XMLReader &) = delete;
+        XMLReader &operator=(const XMLReader &) = delete;
+
+        void Feed(std::string_view chunk)
+        {
+            // what is consumed is dropped, only the current construct stay
+            _buffer.erase(0, _position);
+            _base += _position;
+            _position = 0;
+            _buffer.append(chunk);
+            _input = _buffer;
+        }
+
+        void Finish() noexcept { _finished = true; }
+
+        XMLToken Next()
+        {
+            auto &promise = _routine.handle.promise();
+            if (_routine.handle.done())
+            {
+                return promise.token;
+            }
+            _routine.handle.resume();
+            if (promise.exception != nullptr)
+            {
+                std::rethrow_exception(std::exchange(promise.exception, {}));
+            }
+            return promise.token;
+        }
+
+        // of the last StartElement or Declaration
+        [[nodiscard]] const std::vector<Attribute> &Attributes() const noexcept
+        {
+            return _attributes;
+        }
+
+        // open elements, after the last token
+        [[nodiscard]] size_t Depth() const noexcept { return _parser._depth; }
+
+        [[nodiscard]] XMLParser::ParseStatus Status() const noexcept
+        {
+            return _parser._status;
+        }
+
+        // offset in all the input fed, of the decoded input if it was
+        // given as a whole in UTF-16 or Latin-1, npos without error
+        [[nodiscard]] size_t ErrorIndex() const noexcept
+        {
+            if (_parser._errorIndex < 0)
+            {
+                return std::string_view::npos;
+            }
+            return _base + _parser._errorIndex;
+        }
+
+        // offset in the input after the last token
+        [[nodiscard]] size_t Offset() const noexcept
+        {
+            return _base + _position;
+        }
+
+        // what offsets of a reader given a whole input refer to, the input
+        // transcoded to UTF-8
+        [[nodiscard]] std::string_view Input() const noexcept
+        {
+            return _input;
+        }
+
+        // errors of a ParseRecover reader, offsets are in the current
+        // buffer only when it was given as a whole
+        [[nodiscard]] const std::vector<XMLParser::Diagnostic> &
+        Diagnostics() const noexcept
+        {
+            return _parser.Diagnostics();
+        }
+
+    private:
+        // decoded text, a view into the input unless a reference had to be
+        // replaced
+        class ViewText
+        {
+        public:
+            // contents or entity value, both outlive the token
+            void append(std::string_view text)
+            {
+                if (!_owned && _view.empty())
+                {
+                    _view = text;
+                    return;
+                }
+                _Own();
+                _buffer.append(text);
+            }
+
+            // a replaced char, copied
+            void append(const char *text, size_t size)
+            {
+                _Own();
+                _buffer.append(text, size);
+            }
+
+            void push_back(char c)
+            {
+                _Own();
+                _buffer.push_back(c);
+            }
+
+            [[nodiscard]] std::string_view View() const noexcept
+            {
+                return _owned ? std::string_view(_buffer) : _view;
+            }
+
+        private:
+            std::string_view _view;
+
+            std::string _buffer;
+
+            bool _owned = false;
+
+            void _Own()
+            {
+                if (!_owned)
+                {
+                    _buffer.assign(_view);
+                    _owned = true;
+                }
+            }
+        };
+
+        // turn the handler calls of a construct into queued tokens
+        class TokenHandler
+        {
+        public:
+            using Text = ViewText;
+
+            explicit TokenHandler(XMLReader &reader) : _reader(reader) {}
+
+            void StartElement(std::string_view tag)
+            {
+                _tag = tag;
+                _reader._attributeCount = 0;
+            }
+
+            void StartDeclaration() { _reader._attributeCount = 0; }
+
+            bool Attribute(std::string_view name, Text &&value)
+            {
+                auto &reader = _reader;
+                for (size_t k = 0; k < reader._attributeCount; ++k)
+                {
+                    if (reader._attributeNames[k] == name)
+                    {
+                        return false;
+                    }
+                }
+                if (reader._attributeCount == reader._attributeNames.size())
+                {
+                    reader._attributeNames.emplace_back();
+                    reader._attributeValues.emplace_back();
+                }
+                reader._attributeNames[reader._attributeCount] = name;
+                reader._attributeValues[reader._attributeCount] =
+                    std::move(value);
+                ++reader._attributeCount;
+                return true;
+            }
+
+            void EndDeclaration(bool keep)
+            {
+                if (keep)
+                {
+                    _reader._Push(XMLToken::Declaration);
+                }
+            }
+
+            void EmptyElement()
+            {
+                _reader._Push(XMLToken::StartElement, _tag);
+                _reader._Push(XMLToken::EndElement, _tag);
+            }
+
+            void OpenElement()
+            {
+                _reader._Push(XMLToken::StartElement, _tag);
+                // drop the bytes of tags closed by the steps before
+                _reader._openTags.resize(_reader._openTagsSize);
+                _reader._openTags.append(_tag);
+                _reader._openTagsSize += _tag.size();
+                _reader._openTagSizes.push_back(_tag.size());
+            }
+
+            [[nodiscard]] bool IsOpen(std::string_view tag) const
+            {
+                return _Open(1) == tag;
+            }
+
+            [[nodiscard]] size_t Enclosing(std::string_view tag,
+                                           size_t depth) const
+            {
+                size_t last = _reader._openTagsSize;
+                for (size_t n = 1; n <= depth; ++n)
+                {
+                    auto size = _reader._openTagSizes[
+                        _reader._openTagSizes.size() - n];
+                    if (std::string_view(_reader._openTags)
+                            .substr(last - size, size)
+                        == tag)
+                    {
+                        return n;
+                    }
+                    last -= size;
+                }
+                return 0;
+            }
+
+            void CloseElement()
+            {
+                // the bytes stay until a later step open a element, so
+                // the token can view them
+                auto tag = _Open(1);
+                _reader._openTagsSize -= tag.size();
+                _reader._openTagSizes.pop_back();
+                _reader._Push(XMLToken::EndElement, tag);
+            }
+
+            void Data(Text &&text, bool)
+            {
+                _reader._text = std::move(text);
+                _reader._Push(XMLToken::Text, {}, _reader._text.View());
+            }
+
+            void Comment(std::string_view text)
+            {
+                _reader._Push(XMLToken::Comment, {}, text);
+            }
+
+            void CData(std::string_view text)
+            {
+                _reader._Push(XMLToken::CData, {}, text);
+            }
+
+            void PI(std::string_view name, std::string_view text)
+            {
+                _reader._Push(XMLToken::PI, name, text);
+            }
+
+            void Doctype(std::string_view text)
+            {
+                _reader._Push(XMLToken::Doctype, {}, text);
+            }
+
+        private:
+            XMLReader &_reader;
+
+            std::string_view _tag;
+
+            // tag of the nth innermost open element
+            [[nodiscard]] std::string_view _Open(size_t n) const
+            {
+                auto &sizes = _reader._openTagSizes;
+                size_t last = _reader._openTagsSize;
+                for (size_t k = 1; k < n; ++k)
+                {
+                    last -= sizes[sizes.size() - k];
+                }
+                auto size = sizes[sizes.size() - n];
+                return std::string_view(_reader._openTags)
+                    .substr(last - size, size);
+            }
+        };
+
+        // just enough of a generator for Next(), the token yielded last is
+        // kept in the promise
+        struct Routine
+        {
+            struct promise_type
+            {
+                XMLToken token;
+
+                // thrown again by Next()
+                std::exception_ptr exception;
+
+                Routine get_return_object()
+                {
+                    return Routine {
+                        std::coroutine_handle<promise_type>::from_promise(
+                            *this)};
+                }
+
+                std::suspend_always initial_suspend() noexcept { return {}; }
+
+                std::suspend_always final_suspend() noexcept { return {}; }
+
+                std::suspend_always yield_value(XMLToken value) noexcept
+                {
+                    token = value;
+                    return {};
+                }
+
+                void return_void() noexcept {}
+
+                // the coroutine is then at its final suspend, it is never
+                // resumed again
+                void unhandled_exception() noexcept
+                {
+                    token = XMLToken {XMLToken::Error};
+                    exception = std::current_exception();
+                }
+            };
+
+            explicit Routine(std::coroutine_handle<promise_type> handle) :
+                handle(handle)
+            {
+            }
+
+            Routine(const Routine &) = delete;
+            Routine &operator=(const Routine &) = delete;
+
+            ~Routine() { handle.destroy(); }
+
+            std::coroutine_handle<promise_type> handle;
+        };
+
+        XMLParser _parser;
+
+        // the input when given as a whole, else _buffer
+        std::string_view _input;
+
+        std::string _buffer;
+
+        // of the next construct in _input
+        size_t _position = 0;
+
+        // bytes dropped from the front of _buffer
+        size_t _base = 0;
+
+        bool _whole = false;
+
+        bool _finished = false;
+
+        // tokens of the last construct, more than two only when a recovered
+        // end tag close several elements
+        std::vector<XMLToken> _tokens;
+
+        // tags of open elements one after another, the first _openTagsSize
+        // bytes are open
+        std::string _openTags;
+
+        size_t _openTagsSize = 0;
+
+        std::vector<size_t> _openTagSizes;
+
+        std::vector<std::string_view> _attributeNames;
+
+        std::vector<ViewText> _attributeValues;
+
+        size_t _attributeCount = 0;
+
+        std::vector<Attribute> _attributes;
+
+        ViewText _text;
+
+        TokenHandler _handler;
+
+        // last member, it start after the others are made
+        Routine _routine;
+
+        void _Push(XMLToken::Type type, std::string_view name = {},
+                   std::string_view value = {})
+        {
+            _tokens.push_back({type, name, value});
+        }
+
+        // the whole construct at _position is in _input, so the grammar
+        // never see a construct cut by the end of a chunk
+        [[nodiscard]] bool _Ready() const
+        {
+            if (_finished)
+            {
+                return true;
+            }
+            auto i = _input.find_first_not_of(XMLParser::Blank, _position);
+            // long enough to tell <![CDATA[ and <?xml from others
+            if (i == std::string_view::npos || _input.size() - i < 9)
+            {
+                return false;
+            }
+            auto rest = _input.substr(i);
+            if (rest[0] != '<')
+            {
+                return rest.find('<') != std::string_view::npos;
+            }
+            if (rest.substr(0, 4) == "<!--")
+            {
+                return rest.find("-->", 4) != std::string_view::npos;
+            }
+            if (rest.substr(0, 9) == "<![CDATA[")
+            {
+                return rest.find("]]>", 9) != std::string_view::npos;
+            }
+            if (rest.substr(0, 2) == "<?")
+            {
+                return rest.find("?>", 2) != std::string_view::npos;
+            }
+            if (rest.substr(0, 9) == "<!DOCTYPE")
+            {
+                auto last = rest.find_first_of("[>");
+                if (last != std::string_view::npos && rest[last] == '[')
+                {
+                    last = rest.find(']', last);
+                    last = last == std::string_view::npos
+                               ? last
+                               : rest.find('>', last);
+                }
+                return last != std::string_view::npos;
+            }
+            // a '>' in a attribute value doesn't end the tag
+            size_t k = 0;
+            while ((k = rest.find_first_of("\"'>", k))
+                   != std::string_view::npos)
+            {
+                if (rest[k] == '>')
+                {
+                    return true;
+                }
+                k = rest.find(rest[k], k + 1);
+                if (k == std::string_view::npos)
+                {
+                    return false;
+                }
+                ++k;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool _Failed()
+        {
+            if (_parser._status == XMLParser::NoError)
+            {
+                return false;
+            }
+            // the tokens of a failed construct are dropped
+            _tokens.clear();
+            return true;
+        }
+
+        void _FillAttributes()
+        {
+            _attributes.clear();
+            for (size_t k = 0; k < _attributeCount; ++k)
+            {
+                _attributes.push_back(
+                    {_attributeNames[k], _attributeValues[k].View()});
+            }
+        }
+
+        Routine _Run()
+        {
+            _parser._Reset();
+            if (_whole)
+            {
+                // offsets of a encoding error are in the input as it is
+                _parser._source = _input;
+                if (auto decoded = _parser._DecodeInput(_input);
+                    _parser._status == XMLParser::NoError)
+                {
+                    _input = decoded;
+                    _parser._source = decoded;
+                }
+            }
+            else
+            {
+                while (!_finished && _input.size() < 3)
+                {
+                    co_yield XMLToken {XMLToken::NeedInput};
+                }
+                if (_input.substr(0, 3) == "\xEF\xBB\xBF")
+                {
+                    _position = 3;
+                }
+            }
+
+            // declaration, prolog, then content, one construct a step
+            enum
+            {
+                AtDeclaration,
+                InProlog,
+                InContent
+            } part = AtDeclaration;
+            while (_parser._status == XMLParser::NoError)
+            {
+                while (!_Ready())
+                {
+                    co_yield XMLToken {XMLToken::NeedInput};
+                }
+                auto first = _position;
+                if (part == AtDeclaration)
+                {
+                    part = InProlog;
+                    _parser._ParseBlank(_input, _position);
+                    if (_parser._IsXMLDeclarationStart(_input, _position))
+                    {
+                        _position += 5;
+                        _parser._ParseDeclaration(_input, _position,
+                                                  _handler);
+                    }
+                }
+                else if (part == InProlog)
+                {
+                    if (!_parser._ParseMisc(_input, _position, _handler))
+                    {
+                        part = InContent;
+                    }
+                }
+                else if (_position < _input.size())
+                {
+                    _parser._ParseNext(_input, _position, _handler);
+                }
+                else
+                {
+                    break;
+                }
+                if (_Failed())
+                {
+                    if (!(_parser._parseFlag & XMLParser::ParseRecover))
+                    {
+                        break;
+                    }
+                    part = InContent;
+                    _parser._Resync(_input, _position, first);
+                }
+                for (auto &token : _tokens)
+                {
+                    if (token.type == XMLToken::StartElement
+                        || token.type == XMLToken::Declaration)
+                    {
+                        _FillAttributes();
+                    }
+                    co_yield token;
+                }
+                _tokens.clear();
+            }
+            if (_parser._status == XMLParser::NoError)
+            {
+                _parser._ParseEnd(_position);
+            }
+            auto last = _parser._status == XMLParser::NoError
+                            ? XMLToken::End
+                            : XMLToken::Error;
+            while (true)
+            {
+                co_yield XMLToken {last};
+            }
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_READER_HPP
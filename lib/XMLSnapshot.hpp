@@ -0,0 +1,524 @@
+//// Copyright (C) 2020 FusionBolt
+//// This library distributed under the MIT License
+
+#ifndef CRAFT_XML_SNAPSHOT_HPP
+#define CRAFT_XML_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "CraftXML.hpp"
+
+namespace Craft
+{
+    // binary image of a document tree, to load a large document again
+    // without parsing it, the XML stay the source of truth and the image is
+    // only a cache of it
+    //
+    // header, then four sections, all positions are offsets so the image
+    // can be mapped anywhere:
+    //   nodes       preorder, parent index, type, name id, content
+    //   attributes  of the nodes in node order
+    //   names       tags and attribute names, each stored once
+    //   heap        bytes of names, contents and attribute values
+    //
+    // the image is in the byte order of the machine which wrote it, a image
+    // from another version or byte order is rejected
+    class XMLSnapshot
+    {
+    public:
+        enum SnapshotStatus
+        {
+            SnapshotOk = 0,
+            SnapshotOpenFailed,
+            // not a snapshot, another version or byte order, or truncated
+            SnapshotFormatError,
+            SnapshotChecksumError,
+            // made from another version of the source
+            SnapshotStale,
+            // a string of 4 GiB or more, or too many nodes
+            SnapshotTooLarge
+        };
+
+        static constexpr uint32_t Version = 1;
+
+        // image of the tree of document, sourceKey identify the source it
+        // was loaded from (its mtime, size, Checksum(xml), ...)
+        static SnapshotStatus Write(const XMLDocument &document,
+                                    std::string &image,
+                                    uint64_t sourceKey = 0)
+        {
+            Builder builder;
+            auto status = builder.Add(document._node);
+            if (status != SnapshotOk)
+            {
+                return status;
+            }
+            builder.Finish(image, sourceKey);
+            return SnapshotOk;
+        }
+
+        static SnapshotStatus Save(const XMLDocument &document,
+                                   const std::string &fileName,
+                                   uint64_t sourceKey = 0)
+        {
+            std::string image;
+            auto status = Write(document, image, sourceKey);
+            if (status != SnapshotOk)
+            {
+                return status;
+            }
+            std::ofstream file(fileName, std::ios::out | std::ios::binary
+                                             | std::ios::trunc);
+            if (!file.is_open()
+                || !file.write(image.data(),
+                               static_cast<std::streamsize>(image.size())))
+            {
+                return SnapshotOpenFailed;
+            }
+            return SnapshotOk;
+        }
+
+        // replace the tree of document by the one of image, a sourceKey
+        // other than 0 must be the one the image was written with
+        // the document is left as it was on failure
+        static SnapshotStatus Read(XMLDocument &document,
+                                   std::string_view image,
+                                   uint64_t sourceKey = 0)
+        {
+            Header header;
+            auto status = _Check(image, sourceKey, header);
+            if (status != SnapshotOk)
+            {
+                return status;
+            }
+            XMLNode::XMLNodeStruct *root = nullptr;
+            status = _Rebuild(image, header, root);
+            if (status != SnapshotOk)
+            {
+                return status;
+            }
+            if (document._index != nullptr)
+            {
+                document._index->Clear();
+            }
+            auto *cleared = document._TakeCleared();
+            document._node = root;
+            root->_index = document._index.get();
+            if (document._index != nullptr)
+            {
+                document._index->AddSubtree(root);
+            }
+            XMLDocument::_FreeCleared(cleared);
+            return SnapshotOk;
+        }
+
+        // the file is mapped and read in place where mmap is available
+        static SnapshotStatus Load(XMLDocument &document,
+                                   const std::string &fileName,
+                                   uint64_t sourceKey = 0)
+        {
+#ifdef __linux__
+            int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return SnapshotOpenFailed;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+            {
+                close(fd);
+                return SnapshotOpenFailed;
+            }
+            auto size = static_cast<size_t>(info.st_size);
+            if (size == 0)
+            {
+                close(fd);
+                return SnapshotFormatError;
+            }
+            void *image = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (image == MAP_FAILED)
+            {
+                return SnapshotOpenFailed;
+            }
+            // read once from front to back
+            madvise(image, size, MADV_SEQUENTIAL);
+            auto status = Read(
+                document, std::string_view(static_cast<char *>(image), size),
+                sourceKey);
+            munmap(image, size);
+            return status;
+#else
+            std::ifstream file(fileName, std::ios::in | std::ios::binary);
+            if (!file.is_open())
+            {
+                return SnapshotOpenFailed;
+            }
+            std::string image((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+            return Read(document, image, sourceKey);
+#endif
+        }
+
+        // 64 bit hash of data, a word at a time, used for the image and
+        // handy as a sourceKey
+        [[nodiscard]] static uint64_t Checksum(std::string_view data) noexcept
+        {
+            uint64_t hash = 0xcbf29ce484222325ULL;
+            constexpr uint64_t prime = 0x100000001b3ULL;
+            size_t i = 0;
+            for (; i + 8 <= data.size(); i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, data.data() + i, 8);
+                hash = (hash ^ word) * prime;
+                hash ^= hash >> 29;
+            }
+            for (; i < data.size(); ++i)
+            {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+            }
+            return hash;
+        }
+
+    private:
+        using NodeStruct = XMLNode::XMLNodeStruct;
+
+        static constexpr char Magic[8] = {'C', 'R', 'A', 'F',
+                                          'T', 'X', 'S', 'N'};
+
+        static constexpr uint32_t ByteOrder = 0x01020304;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t byteOrder;
+            uint64_t sourceKey;
+            uint64_t nodeCount;
+            uint64_t attributeCount;
+            uint64_t nameCount;
+            uint64_t heapSize;
+            // of everything after the header
+            uint64_t checksum;
+        };
+
+        struct NodeRecord
+        {
+            uint32_t type;
+            uint32_t name;
+            // index of parent, which is always before the node
+            uint32_t parent;
+            uint32_t attributeCount;
+            uint64_t content;
+            uint32_t contentSize;
+            uint32_t reserved;
+        };
+
+        struct AttributeRecord
+        {
+            uint32_t name;
+            uint32_t valueSize;
+            uint64_t value;
+        };
+
+        struct NameRecord
+        {
+            uint64_t offset;
+            uint32_t size;
+            uint32_t reserved;
+        };
+
+        static_assert(sizeof(Header) == 64 && sizeof(NodeRecord) == 32
+                      && sizeof(AttributeRecord) == 16
+                      && sizeof(NameRecord) == 16);
+
+        // sections of the image being written
+        class Builder
+        {
+        public:
+            SnapshotStatus Add(NodeStruct *root)
+            {
+                // ancestors of the current node with their index
+                std::vector<std::pair<const NodeStruct *, uint32_t>> path;
+                for (auto *node = root; node != nullptr;
+                     node = XMLNode::_NextPreorder(node, root))
+                {
+                    while (!path.empty() && path.back().first != node->_parent)
+                    {
+                        path.pop_back();
+                    }
+                    if (_nodes.size() >= UINT32_MAX)
+                    {
+                        return SnapshotTooLarge;
+                    }
+                    NodeRecord record {};
+                    record.type = node->_type;
+                    record.name = _Intern(node->_tag);
+                    record.parent = path.empty() ? 0 : path.back().second;
+                    record.attributeCount =
+                        static_cast<uint32_t>(node->_attributes.size());
+                    if (!_Store(node->_content, record.content,
+                                record.contentSize))
+                    {
+                        return SnapshotTooLarge;
+                    }
+                    for (auto &[name, value] : node->_attributes)
+                    {
+                        AttributeRecord attribute {};
+                        attribute.name = _Intern(name);
+                        if (!_Store(value, attribute.value,
+                                    attribute.valueSize))
+                        {
+                            return SnapshotTooLarge;
+                        }
+                        _attributes.push_back(attribute);
+                    }
+                    path.emplace_back(node,
+                                      static_cast<uint32_t>(_nodes.size()));
+                    _nodes.push_back(record);
+                }
+                return SnapshotOk;
+            }
+
+            void Finish(std::string &image, uint64_t sourceKey)
+            {
+                Header header {};
+                std::memcpy(header.magic, Magic, sizeof(Magic));
+                header.version = Version;
+                header.byteOrder = ByteOrder;
+                header.sourceKey = sourceKey;
+                header.nodeCount = _nodes.size();
+                header.attributeCount = _attributes.size();
+                header.nameCount = _names.size();
+                header.heapSize = _heap.size();
+
+                image.clear();
+                image.reserve(sizeof(Header)
+                              + _nodes.size() * sizeof(NodeRecord)
+                              + _attributes.size() * sizeof(AttributeRecord)
+                              + _names.size() * sizeof(NameRecord)
+                              + _heap.size());
+                image.append(reinterpret_cast<const char *>(&header),
+                             sizeof(header));
+                _Append(image, _nodes);
+                _Append(image, _attributes);
+                _Append(image, _names);
+                image.append(_heap);
+                header.checksum = Checksum(
+                    std::string_view(image).substr(sizeof(Header)));
+                std::memcpy(image.data(), &header, sizeof(header));
+            }
+
+        private:
+            std::vector<NodeRecord> _nodes;
+
+            std::vector<AttributeRecord> _attributes;
+
+            std::vector<NameRecord> _names;
+
+            std::string _heap;
+
+            // views into the names of the tree, which outlive the builder
+            std::unordered_map<std::string_view, uint32_t> _nameIds;
+
+            uint32_t _Intern(std::string_view name)
+            {
+                auto [it, added] = _nameIds.emplace(
+                    name, static_cast<uint32_t>(_names.size()));
+                if (added)
+                {
+                    NameRecord record {};
+                    _Store(name, record.offset, record.size);
+                    _names.push_back(record);
+                }
+                return it->second;
+            }
+
+            bool _Store(std::string_view text, uint64_t &offset,
+                        uint32_t &size)
+            {
+                if (text.size() >= UINT32_MAX)
+                {
+                    return false;
+                }
+                offset = _heap.size();
+                size = static_cast<uint32_t>(text.size());
+                _heap.append(text);
+                return true;
+            }
+
+            template<typename Record>
+            static void _Append(std::string &image,
+                                const std::vector<Record> &records)
+            {
+                image.append(reinterpret_cast<const char *>(records.data()),
+                             records.size() * sizeof(Record));
+            }
+        };
+
+        static SnapshotStatus _Check(std::string_view image,
+                                     uint64_t sourceKey, Header &header)
+        {
+            if (image.size() < sizeof(Header))
+            {
+                return SnapshotFormatError;
+            }
+            std::memcpy(&header, image.data(), sizeof(header));
+            if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+                || header.version != Version || header.byteOrder != ByteOrder
+                || header.nodeCount == 0 || header.nodeCount >= UINT32_MAX
+                || header.nameCount >= UINT32_MAX)
+            {
+                return SnapshotFormatError;
+            }
+            // each section must fit in what is left, counts are divided
+            // instead of multiplied so a bad count can't overflow
+            auto rest = image.size() - sizeof(Header);
+            if (!_Take(rest, header.nodeCount, sizeof(NodeRecord))
+                || !_Take(rest, header.attributeCount, sizeof(AttributeRecord))
+                || !_Take(rest, header.nameCount, sizeof(NameRecord))
+                || header.heapSize != rest)
+            {
+                return SnapshotFormatError;
+            }
+            if (sourceKey != 0 && header.sourceKey != sourceKey)
+            {
+                return SnapshotStale;
+            }
+            if (Checksum(image.substr(sizeof(Header))) != header.checksum)
+            {
+                return SnapshotChecksumError;
+            }
+            return SnapshotOk;
+        }
+
+        // sections are checked before any node is made, root is only set
+        // if the whole tree could be made
+        static SnapshotStatus _Rebuild(std::string_view image,
+                                       const Header &header,
+                                       NodeStruct *&root)
+        {
+            auto *section = image.data() + sizeof(Header);
+            auto *nodeRecords = section;
+            auto *attributeRecords =
+                nodeRecords + header.nodeCount * sizeof(NodeRecord);
+            auto *nameRecords = attributeRecords
+                                + header.attributeCount
+                                      * sizeof(AttributeRecord);
+            auto heap = std::string_view(
+                nameRecords + header.nameCount * sizeof(NameRecord),
+                header.heapSize);
+
+            std::vector<std::string_view> names(header.nameCount);
+            for (size_t k = 0; k < names.size(); ++k)
+            {
+                auto record = _Record<NameRecord>(nameRecords, k);
+                if (!_InHeap(heap, record.offset, record.size))
+                {
+                    return SnapshotFormatError;
+                }
+                names[k] = heap.substr(record.offset, record.size);
+            }
+            uint64_t attributeTotal = 0;
+            for (size_t k = 0; k < header.nodeCount; ++k)
+            {
+                auto record = _Record<NodeRecord>(nodeRecords, k);
+                bool isRoot = k == 0;
+                if (record.type >= XMLNode::NullNode
+                    || (record.type == XMLNode::NodeDocument) != isRoot
+                    || (!isRoot && record.parent >= k)
+                    || record.name >= names.size()
+                    || !_InHeap(heap, record.content, record.contentSize))
+                {
+                    return SnapshotFormatError;
+                }
+                attributeTotal += record.attributeCount;
+            }
+            if (attributeTotal != header.attributeCount)
+            {
+                return SnapshotFormatError;
+            }
+            for (size_t k = 0; k < header.attributeCount; ++k)
+            {
+                auto record = _Record<AttributeRecord>(attributeRecords, k);
+                if (record.name >= names.size()
+                    || !_InHeap(heap, record.value, record.valueSize))
+                {
+                    return SnapshotFormatError;
+                }
+            }
+
+            auto &pool = XMLNode::_Pool();
+            std::vector<NodeStruct *> nodes(header.nodeCount);
+            size_t attributeIndex = 0;
+            for (size_t k = 0; k < nodes.size(); ++k)
+            {
+                auto record = _Record<NodeRecord>(nodeRecords, k);
+                auto *node = pool.New(
+                    std::string(names[record.name]),
+                    std::string(heap.substr(record.content,
+                                            record.contentSize)),
+                    static_cast<XMLNode::NodeType>(record.type));
+                auto &attributes = node->_attributes;
+                for (uint32_t n = 0; n < record.attributeCount; ++n)
+                {
+                    auto attribute = _Record<AttributeRecord>(
+                        attributeRecords, attributeIndex++);
+                    // written in map order, each one go to the end
+                    attributes.emplace_hint(
+                        attributes.end(), names[attribute.name],
+                        heap.substr(attribute.value, attribute.valueSize));
+                }
+                if (k != 0)
+                {
+                    XMLNode(nodes[record.parent])._LinkChild(node);
+                }
+                nodes[k] = node;
+            }
+            root = nodes[0];
+            return SnapshotOk;
+        }
+
+        template<typename Record>
+        static Record _Record(const char *records, size_t k) noexcept
+        {
+            Record record;
+            std::memcpy(&record, records + k * sizeof(Record), sizeof(Record));
+            return record;
+        }
+
+        static bool _Take(uint64_t &rest, uint64_t count,
+                          size_t recordSize) noexcept
+        {
+            if (count > rest / recordSize)
+            {
+                return false;
+            }
+            rest -= count * recordSize;
+            return true;
+        }
+
+        static bool _InHeap(std::string_view heap, uint64_t offset,
+                            uint64_t size) noexcept
+        {
+            return offset <= heap.size() && size <= heap.size() - offset;
+        }
+    };
+} // namespace Craft
+
+#endif // CRAFT_XML_SNAPSHOT_HPP
@@ -4,6 +4,14 @@
 #include <iostream>
 
 #include "../lib/CraftXML.hpp"
+#include "../lib/RecordSplitter.hpp"
+#include "../lib/XMLBinder.hpp"
+#include "../lib/XMLCanonical.hpp"
+#include "../lib/XMLDiff.hpp"
+#include "../lib/XMLDocumentCache.hpp"
+#include "../lib/XMLOverlay.hpp"
+#include "../lib/XMLReader.hpp"
+#include "../lib/XMLSnapshot.hpp"
 
 using namespace Craft;
 
@@ -30,7 +38,7 @@ using namespace Craft;
 
 #define ERROR_STR_OUTPUT(InputStr)                                             \
     std::cout << "Error Str:" << InputStr                                      \
-              << "\nParseErrorType:" << result.ErrorInfo() << std::endl;       \
+              << "\nParseErrorType:" << result.Message() << std::endl;         \
     DEBUG_INFO;
 
 #define ASSERT_EQ(Val1, Val2)                                                  \
@@ -92,6 +100,77 @@ bool NodeStructTest()
     return true;
 }
 
+// tags of the children of node
+std::string ChildTags(const XMLNode &node)
+{
+    std::string tags;
+    for (auto child : node.Children())
+    {
+        tags += child.GetNodeTag();
+    }
+    return tags;
+}
+
+bool NodeMutationTest()
+{
+    XMLDocument document;
+    document.SetIndexedAttributes({"id"});
+    document.LoadString(R"(<r><a id="1"><x id="2"/></a><b/><c/></r>)");
+    auto r = document.FirstChild();
+    auto a = r.FirstChild();
+    auto b = a.NextSibling();
+    auto c = b.NextSibling();
+    ASSERT_TRUE(a.PrevSibling().IsEmpty())
+    ASSERT_EQ(c.PrevSibling().GetNodeTag(), "b")
+    ASSERT_TRUE(c.NextSibling().IsEmpty())
+    ASSERT_TRUE(document.NextSibling().IsEmpty())
+
+    XMLNode d("d");
+    r.InsertBefore(d, a);
+    ASSERT_EQ(ChildTags(r), "dabc")
+    ASSERT_TRUE(d.PrevSibling().IsEmpty())
+    XMLNode e("e");
+    r.InsertAfter(e, c);
+    ASSERT_EQ(ChildTags(r), "dabce")
+    ASSERT_EQ(r.LastChild().GetNodeTag(), "e")
+
+    // move, the subtree go with it
+    r.InsertAfter(a, c);
+    ASSERT_EQ(ChildTags(r), "dbcae")
+    // already in place
+    r.InsertAfter(a, c);
+    ASSERT_EQ(ChildTags(r), "dbcae")
+    r.InsertBefore(b, c);
+    ASSERT_EQ(ChildTags(r), "dbcae")
+    c.AddChild(a);
+    ASSERT_EQ(ChildTags(r), "dbce")
+    ASSERT_EQ(ChildTags(c), "a")
+    ASSERT_EQ(document.FindById("2").GetParent().GetParent().GetNodeTag(), "c")
+    b.SetParent(c);
+    ASSERT_EQ(ChildTags(c), "ab")
+
+    r.RemoveChild(c);
+    ASSERT_EQ(ChildTags(r), "de")
+    ASSERT_TRUE(document.FindById("1").IsEmpty())
+    ASSERT_TRUE(document.FindById("2").IsEmpty())
+    r.RemoveChild(d);
+    r.RemoveChild(e);
+    ASSERT_FALSE(r.HasChild())
+    XMLNode f("f");
+    r.AddChild(f);
+    ASSERT_EQ(ChildTags(r), "f")
+    ASSERT_TRUE(f.PrevSibling().IsEmpty())
+    ASSERT_TRUE(f.NextSibling().IsEmpty())
+
+    XMLNode g("g");
+    g.Detach();
+    f.AddChild(g);
+    g.Detach();
+    ASSERT_FALSE(f.HasChild())
+    ASSERT_TRUE(g.NextSibling().IsEmpty())
+    return true;
+}
+
 bool OneTagTest1()
 {
     ASSERT_NO_ERROR_PARSE_STRING("<hr />")
@@ -163,16 +242,90 @@ bool ContentCDATATest()
 
 bool EntityReferenceTest()
 {
-#define ENTITY_OK(Str, Char) i = 1;
+#define ENTITY_OK(Str, Expect)                                                 \
+    i = 1;                                                                     \
+    out.clear();                                                               \
+    ASSERT_TRUE(p.ParseCharReference(Str, i, out))                            \
+    ASSERT_EQ(out, Expect)                                                     \
+    ASSERT_EQ(i, std::string_view(Str).size())
 
-    // ASSERT_EQ(p.ParseCharReference(Str, i), Char)
     XMLParser p;
     size_t i = 0;
-    ENTITY_OK("&lt;", '<')
-    ENTITY_OK("&gt;", '>')
-    ENTITY_OK("&amp;", '&')
-    ENTITY_OK("&apos;", '\'')
-    ENTITY_OK("&quot;", '"')
+    std::string out;
+    ENTITY_OK("&lt;", "<")
+    ENTITY_OK("&gt;", ">")
+    ENTITY_OK("&amp;", "&")
+    ENTITY_OK("&apos;", "'")
+    ENTITY_OK("&quot;", "\"")
+    ENTITY_OK("&#65;", "A")
+    ENTITY_OK("&#x3c;", "<")
+    ENTITY_OK("&#xE9;", "\xC3\xA9")
+    ENTITY_OK("&#x4E2D;", "\xE4\xB8\xAD")
+    ENTITY_OK("&#128512;", "\xF0\x9F\x98\x80")
+
+    i = 1;
+    ASSERT_FALSE(p.ParseCharReference("&unknown;", i, out))
+    ASSERT_EQ(i, 1)
+    ASSERT_EQ(p.Status(), XMLParser::NoError)
+    return true;
+}
+
+bool CharReferenceErrorTest()
+{
+    ASSERT_PARSE_STRING("<tag>&#;</tag>", XMLParser::CharReferenceError)
+    ASSERT_PARSE_STRING("<tag>&#xD800;</tag>", XMLParser::CharReferenceError)
+    ASSERT_PARSE_STRING("<tag>&#x110000;</tag>",
+                        XMLParser::CharReferenceError)
+    ASSERT_PARSE_STRING("<tag a=\"&#65\"/>", XMLParser::CharReferenceError)
+    return true;
+}
+
+bool DoctypeEntityTest()
+{
+    ASSERT_NO_ERROR_PARSE_STRING("<!DOCTYPE note [\n"
+                                 "<!ENTITY writer \"Donald &amp; Duck\">\n"
+                                 "<!ENTITY sign '&writer;&#x21;'>\n"
+                                 "<!ENTITY writer \"ignored\">\n"
+                                 "<!ENTITY % param \"skip\">\n"
+                                 "<!ENTITY ext SYSTEM \"ext.xml\">\n"
+                                 "]>\n"
+                                 "<note a=\"&sign;\">&writer; &ext;</note>")
+    auto note = document.FindFirstChildByTagName("note");
+    ASSERT_EQ(note.GetNodeContent(), "Donald & Duck &ext;")
+    ASSERT_EQ(note.GetNodeAttribute("a"), "Donald & Duck!")
+    return true;
+}
+
+bool EntityExpansionLimitTest()
+{
+    ASSERT_PARSE_STRING("<!DOCTYPE lol [\n"
+                        "<!ENTITY a \"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\">\n"
+                        "<!ENTITY b \"&a;&a;&a;&a;&a;&a;&a;&a;&a;&a;\">\n"
+                        "<!ENTITY c \"&b;&b;&b;&b;&b;&b;&b;&b;&b;&b;\">\n"
+                        "<!ENTITY d \"&c;&c;&c;&c;&c;&c;&c;&c;&c;&c;\">\n"
+                        "<!ENTITY e \"&d;&d;&d;&d;&d;&d;&d;&d;&d;&d;\">\n"
+                        "<!ENTITY f \"&e;&e;&e;&e;&e;&e;&e;&e;&e;&e;\">\n"
+                        "]>\n"
+                        "<lol>&f;</lol>",
+                        XMLParser::EntityExpansionError)
+    ASSERT_PARSE_STRING("<!DOCTYPE loop [\n"
+                        "<!ENTITY a \"&b;\">\n"
+                        "<!ENTITY b \"&a;\">\n"
+                        "]>\n"
+                        "<loop>&a;</loop>",
+                        XMLParser::EntityExpansionError)
+
+    // a error inside a replacement text is at the reference in the document
+    XMLParser parser;
+    std::string str = "<!DOCTYPE r [ <!ENTITY a '&#xZZ;'> ]>\n<r>&a;</r>";
+    parser.ParseString(str);
+    ASSERT_EQ(parser.Status(), XMLParser::CharReferenceError)
+    ASSERT_EQ(parser.ErrorIndex(), static_cast<int>(str.find("&a;")))
+    str = "<!DOCTYPE loop [<!ENTITY a \"&b;\"><!ENTITY b \"&a;\">]>"
+          "<loop>&a;</loop>";
+    parser.ParseString(str);
+    ASSERT_EQ(parser.Status(), XMLParser::EntityExpansionError)
+    ASSERT_EQ(parser.ErrorIndex(), static_cast<int>(str.find("&a;<")))
     return true;
 }
 
@@ -187,6 +340,9 @@ bool DoctypeTest()
                                  "<student>My Name</student>");
     auto s = document.FindFirstChildByTagName("student");
     ASSERT_EQ(s.GetNodeContent(), "My Name");
+    auto doctype = document.FindFirstChildByType(XMLNode::NodeDoctype);
+    ASSERT_EQ(doctype.GetNodeContent().substr(0, 9), "student [")
+    ASSERT_EQ(doctype.GetNodeContent().back(), ']')
     return true;
 }
 
@@ -272,6 +428,29 @@ bool MultiAttributeTest()
     return true;
 }
 
+bool NumericAccessorTest()
+{
+    ASSERT_NO_ERROR_PARSE_STRING(
+        R"(<r><i n=" -42 " big="9000000000" f="1.5e3" t="true" z="0">7</i>)"
+        R"(<d> 0.25 </d><bad>12px</bad><e/></r>)")
+    auto i = document.FirstChild().FirstChild();
+    ASSERT_EQ(i.AsInt().value(), 7)
+    ASSERT_EQ(i.AttributeAs<int>("n").value(), -42)
+    ASSERT_FALSE(i.AttributeAs<int>("big").has_value())
+    ASSERT_EQ(i.AttributeAs<long long>("big").value(), 9000000000LL)
+    ASSERT_EQ(i.AttributeAs<double>("f").value(), 1500)
+    ASSERT_TRUE(i.AttributeAs<bool>("t").value())
+    ASSERT_FALSE(i.AttributeAs<bool>("z").value())
+    ASSERT_FALSE(i.AttributeAs<bool>("n").has_value())
+    ASSERT_FALSE(i.AttributeAs<int>("missing").has_value())
+    auto d = i.NextSibling();
+    ASSERT_EQ(d.AsDouble().value(), 0.25)
+    ASSERT_FALSE(d.AsInt().has_value())
+    ASSERT_FALSE(d.NextSibling().AsInt().has_value())
+    ASSERT_FALSE(d.NextSibling().NextSibling().AsInt().has_value())
+    return true;
+}
+
 bool AttributeErrorTest()
 {
 #define ATTRIBUTE_ERROR_TEST(str)                                              \
@@ -330,11 +509,1231 @@ bool OperatorOverLoadTest()
     return true;
 }
 
+bool MemoryPoolPolicyTest()
+{
+    auto policy =
+        MemoryPoolPolicy::PoolHugePage | MemoryPoolPolicy::PoolBindNumaNode;
+    MemoryPool<long> pool(policy);
+    ASSERT_EQ(pool.BlockPolicy(), policy)
+    // more than one large block
+    std::vector<long *> values;
+    for (long n = 0; n < 300000; ++n)
+    {
+        values.push_back(pool.New(n));
+    }
+    for (long n = 0; n < 300000; ++n)
+    {
+        ASSERT_EQ(*values[n], n)
+    }
+
+    auto oldPolicy = XMLDocument::NodePoolPolicy();
+    XMLDocument::SetNodePoolPolicy(MemoryPoolPolicy::PoolLargeBlock);
+    XMLDocument document;
+    auto result = document.LoadString("<tag attr=\"1\">content</tag>");
+    XMLDocument::SetNodePoolPolicy(oldPolicy);
+    ASSERT_EQ(result._status, XMLParser::NoError)
+    ASSERT_EQ(document.FirstChild().GetNodeContent(), "content")
+    return true;
+}
+
+bool AttributeIndexTest()
+{
+    XMLDocument document;
+    document.SetIndexedAttributes({"id", "key"});
+    auto result = document.LoadString(
+        R"(<root><a id="first"><b key="k1"/></a><c id="second"/></root>)");
+    ASSERT_EQ(result._status, XMLParser::NoError)
+    ASSERT_EQ(document.FindById("first").GetNodeTag(), "a")
+    ASSERT_EQ(document.FindById("second").GetNodeTag(), "c")
+    ASSERT_EQ(document.FindById("k1").GetNodeTag(), "b")
+    ASSERT_TRUE(document.FindByAttribute("id", "k1").IsEmpty())
+    ASSERT_TRUE(document.FindById("none").IsEmpty())
+
+    // index follow AddChild and AddNodeAttribute
+    XMLNode d("d");
+    XMLNode e("e");
+    e.AddNodeAttribute("id", "third");
+    d.AddChild(e);
+    auto root = document.FirstChild();
+    root.AddChild(d);
+    ASSERT_EQ(document.FindById("third").GetNodeTag(), "e")
+    d.AddNodeAttribute("key", "k2");
+    ASSERT_EQ(document.FindById("k2").GetNodeTag(), "d")
+    e.AddNodeAttribute("id", "renamed");
+    ASSERT_TRUE(document.FindById("third").IsEmpty())
+    ASSERT_EQ(document.FindById("renamed").GetNodeTag(), "e")
+
+    // a repeated value goes to the next element holding it
+    document.LoadString(
+        R"(<r><a id="x"/><b id="x"/><c id="x"/><d id="y"/></r>)");
+    auto r = document.FirstChild();
+    ASSERT_EQ(document.FindById("x").GetNodeTag(), "a")
+    r.FirstChild().AddNodeAttribute("id", "z");
+    ASSERT_EQ(document.FindById("x").GetNodeTag(), "b")
+    auto b = r.FirstChild().NextSibling();
+    r.RemoveChild(b);
+    ASSERT_EQ(document.FindById("x").GetNodeTag(), "c")
+    r.LastChild().PrevSibling().RemoveNodeAttribute("id");
+    ASSERT_TRUE(document.FindById("x").IsEmpty())
+    ASSERT_EQ(document.FindById("y").GetNodeTag(), "d")
+    return true;
+}
+
+bool NodeRangeTest()
+{
+    ASSERT_NO_ERROR_PARSE_STRING(
+        "<a><b><c/><d>text</d></b><e/><b/></a>")
+    std::string order;
+    for (auto node : document.Descendants())
+    {
+        order += node.GetNodeType() == XMLNode::NodeElement ? node.GetNodeTag()
+                                                            : "#";
+    }
+    ASSERT_EQ(order, "abcd#eb")
+
+    auto a = document.FirstChild();
+    auto count = 0;
+    for (auto b : a.Children("b"))
+    {
+        ASSERT_EQ(b.GetNodeTag(), "b")
+        ++count;
+    }
+    ASSERT_EQ(count, 2)
+    ASSERT_TRUE(a.Children("none").empty())
+
+    auto d = a.FirstChild().LastChild();
+    ASSERT_EQ(d.GetNodeTag(), "d")
+    ASSERT_EQ((*d.ChildrenOfType(XMLNode::NodeData).begin()).GetNodeContent(),
+              "text")
+    std::string ancestors;
+    for (auto node : d.Ancestors())
+    {
+        ancestors += node.GetNodeTag() + "/";
+    }
+    ASSERT_EQ(ancestors, "b/a//")
+
+#ifdef __cpp_lib_ranges
+    auto leaves = document.Descendants()
+                  | std::views::filter([](XMLNode node) {
+                        return node.GetNodeType() == XMLNode::NodeElement
+                               && !node.HasChild();
+                    });
+    ASSERT_EQ(std::ranges::distance(leaves), 3)
+#endif
+    return true;
+}
+
+bool NodeGetterReferenceTest()
+{
+    ASSERT_NO_ERROR_PARSE_STRING(R"(<tag attr="value">content</tag>)")
+    auto tag = document.FirstChild();
+    ASSERT_EQ(tag.GetNodeAttribute("attr"), "value")
+    // a missing attribute is not inserted
+    ASSERT_EQ(tag.GetNodeAttribute("none"), "")
+    ASSERT_FALSE(tag.HasNodeAttribute("none"))
+    ASSERT_EQ(tag.GetNodeAttributes().size(), 1)
+    // same storage, no copy
+    ASSERT_EQ(&tag.GetNodeTag(), &document.FirstChild().GetNodeTag())
+    ASSERT_EQ(&tag.GetNodeContent(), &tag.StringValue())
+    return true;
+}
+
+// ASCII text to UTF-16 with BOM
+std::string ToUTF16(std::string_view str, bool littleEndian)
+{
+    std::string utf16 = littleEndian ? "\xFF\xFE" : "\xFE\xFF";
+    for (auto c : str)
+    {
+        utf16.push_back(littleEndian ? c : '\0');
+        utf16.push_back(littleEndian ? '\0' : c);
+    }
+    return utf16;
+}
+
+bool EncodingTest()
+{
+    {
+        auto str = ToUTF16("<?xml version=\"1.0\" encoding=\"UTF-16\"?>"
+                           "<tag attr=\"value\">content</tag>",
+                           true);
+        // U+4E2D and U+1F600 (surrogate pair) at the end of content
+        str.insert(str.size() - 12, std::string("\x2D\x4E\x3D\xD8\x00\xDE", 6));
+        ASSERT_NO_ERROR_PARSE_STRING(str)
+        auto tag = document.FindFirstChildByTagName("tag");
+        ASSERT_EQ(tag.GetNodeAttribute("attr"), "value")
+        ASSERT_EQ(tag.GetNodeContent(),
+                  "content\xE4\xB8\xAD\xF0\x9F\x98\x80")
+    }
+    {
+        auto str = ToUTF16("<tag>a long enough content for a block</tag>",
+                           false);
+        ASSERT_NO_ERROR_PARSE_STRING(str.substr(2))
+        ASSERT_EQ(document.FirstChild().GetNodeContent(),
+                  "a long enough content for a block")
+    }
+    {
+        ASSERT_NO_ERROR_PARSE_STRING(
+            "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><tag>caf\xE9</tag>")
+        ASSERT_EQ(document.FindFirstChildByTagName("tag").GetNodeContent(),
+                  "caf\xC3\xA9")
+    }
+    {
+        ASSERT_NO_ERROR_PARSE_STRING("\xEF\xBB\xBF<tag>text</tag>")
+        ASSERT_EQ(document.FirstChild().GetNodeTag(), "tag")
+    }
+    // lone surrogate
+    ASSERT_PARSE_STRING(ToUTF16("<tag>", true) + std::string("\x00\xDC", 2),
+                        XMLParser::EncodingError)
+    return true;
+}
+
+bool ValidateUTF8Test()
+{
+    XMLDocument document;
+    auto flag = XMLParser::ParseFull | XMLParser::ParseValidateUTF8;
+    ASSERT_EQ(document.LoadString("<tag>caf\xC3\xA9</tag>", flag)._status,
+              XMLParser::NoError)
+    // overlong, surrogate, truncated
+    ASSERT_EQ(document.LoadString("<tag>\xC0\xAF</tag>", flag)._status,
+              XMLParser::EncodingError)
+    ASSERT_EQ(document.LoadString("<tag>\xED\xA0\x80</tag>", flag)._status,
+              XMLParser::EncodingError)
+    auto result = document.LoadString("<tag>0123456789abcdef\xE4\xB8", flag);
+    ASSERT_EQ(result._status, XMLParser::EncodingError)
+    ASSERT_EQ(result._errorIndex, 21)
+    // not checked without the flag
+    ASSERT_EQ(document.LoadString("<tag>\xC0\xAF</tag>")._status,
+              XMLParser::NoError)
+    return true;
+}
+
+bool MaxDepthTest()
+{
+    auto nested = [](size_t depth) {
+        std::string str;
+        for (size_t i = 0; i < depth; ++i)
+        {
+            str += "<a>";
+        }
+        for (size_t i = 0; i < depth; ++i)
+        {
+            str += "</a>";
+        }
+        return str;
+    };
+    XMLDocument document;
+    ASSERT_EQ(document.LoadString(nested(100000))._status, XMLParser::NoError)
+    document.Parser().SetMaxDepth(64);
+    ASSERT_EQ(document.LoadString(nested(64))._status, XMLParser::NoError)
+    auto result = document.LoadString(nested(65));
+    ASSERT_EQ(result._status, XMLParser::DepthLimitError)
+    ASSERT_EQ(result._errorIndex, 64 * 3 + 2)
+    ASSERT_EQ(document.LoadString("<a/></a>")._status,
+              XMLParser::TagNotMatchedError)
+    return true;
+}
+
+bool ValidateTest()
+{
+    std::vector<std::string> inputs = {
+        "<?xml version=\"1.0\"?><!DOCTYPE a [<!ENTITY e \"&#65;\">]>"
+        "<a x=\"1\" y='&e;'><!-- c --><b/>text &amp; &e;<?pi v?>"
+        "<c><![CDATA[<raw>]]></c></a>",
+        "<a><b></a></b>",
+        "<a x=\"1\" x=\"2\"/>",
+        "<a>&#0;</a>",
+        "<a><b>",
+        "</a>",
+        "<a x=1/>",
+        "<a><!-- a -- b --></a>",
+        "<a><?xml version=\"1.0\"?></a>",
+        "<a/ >"};
+    XMLParser parser;
+    XMLParser validator;
+    for (const auto &input : inputs)
+    {
+        parser.ParseString(input);
+        ASSERT_EQ(validator.Validate(input), parser.Status())
+        ASSERT_EQ(validator.ErrorIndex(), parser.ErrorIndex())
+    }
+    // deeper than the inline tag stack
+    std::string deep;
+    for (int i = 0; i < 100; ++i)
+    {
+        deep += "<t" + std::to_string(i) + ">";
+    }
+    for (int i = 99; i >= 0; --i)
+    {
+        deep += "</t" + std::to_string(i) + ">";
+    }
+    ASSERT_EQ(validator.Validate(deep), XMLParser::NoError)
+    deep.replace(deep.rfind("</t0>"), 5, "</t1>");
+    ASSERT_EQ(validator.Validate(deep), XMLParser::TagNotMatchedError)
+    return true;
+}
+
+bool SkippedNodeTest()
+{
+    // PI and CDATA must be consumed even if no node is kept for them
+    auto flag = XMLParser::ParseFull & ~(XMLParser::ParsePI
+                                         | XMLParser::ParseCData);
+    XMLParser parser;
+    auto root = parser.ParseString("<a>x<?pi v?><![CDATA[y]]>z</a>", flag);
+    ASSERT_EQ(parser.Status(), XMLParser::NoError)
+    std::string text;
+    for (auto child : root.FirstChild().Children())
+    {
+        text += child.GetNodeContent();
+    }
+    ASSERT_EQ(text, "xz")
+    return true;
+}
+
+bool ErrorLocationTest()
+{
+    XMLDocument document;
+    auto result = document.LoadString("<a>\n  <b>\n    <c>x</d>\n</a>");
+    ASSERT_EQ(result._status, XMLParser::TagNotMatchedError)
+    ASSERT_EQ(result.Line(), 3)
+    ASSERT_EQ(result.Column(), 12)
+    ASSERT_EQ(result.Snippet(), "    <c>x</d>")
+    ASSERT_EQ(result.Message(),
+              "TagNotMatchedError at line 3, column 12:     <c>x</d>")
+
+    // column count characters, the snippet never cut one
+    result = document.LoadString("<a t=\"\xC3\xA9\xC3\xA9\" t=\"\"/>");
+    ASSERT_EQ(result._status, XMLParser::AttributeRepeatError)
+    ASSERT_EQ(result.Line(), 1)
+    ASSERT_EQ(result.Column(), 15)
+    std::string longLine(100, 'x');
+    result = document.LoadString("<a>" + longLine + "</b>" + longLine);
+    ASSERT_EQ(result.Snippet().size(), 64)
+
+    result = document.LoadString("<a></a>");
+    ASSERT_EQ(result.Line(), 0)
+    ASSERT_EQ(result.Message(), "NoError")
+    result = document.LoadFile("");
+    ASSERT_EQ(result.Line(), 0)
+
+    auto fileName = "ErrorLocationTest.xml";
+    std::ofstream(fileName) << "<a>\r\n<b>&#0;</b>\r\n</a>";
+    result = document.LoadFile(fileName);
+    std::remove(fileName);
+    ASSERT_EQ(result._status, XMLParser::CharReferenceError)
+    ASSERT_EQ(result.Line(), 2)
+    ASSERT_EQ(result.Column(), 7)
+    ASSERT_EQ(result.Snippet(), "<b>&#0;</b>")
+    return true;
+}
+
+bool RecoverTest()
+{
+    std::string str = "<feed><r id=\"1\">ok</r><r id=\"2\" id=\"3\">bad</r>"
+                      "<r id=\"4\"><b>x</r><r id=\"5\">&#0;</r>"
+                      "<r id=\"6\">ok</r></feed>";
+    auto flag = XMLParser::ParseFull | XMLParser::ParseRecover;
+    XMLParser parser;
+    auto root = parser.ParseString(str, flag);
+    ASSERT_EQ(parser.Status(), XMLParser::AttributeRepeatError)
+    auto &diagnostics = parser.Diagnostics();
+    ASSERT_EQ(diagnostics.size(), 4)
+    ASSERT_EQ(diagnostics[0].status, XMLParser::AttributeRepeatError)
+    ASSERT_EQ(diagnostics[0].errorIndex, parser.ErrorIndex())
+    // </r> after the bad start tag match no open element
+    ASSERT_EQ(diagnostics[1].status, XMLParser::TagNotMatchedError)
+    ASSERT_EQ(diagnostics[2].status, XMLParser::TagNotMatchedError)
+    ASSERT_EQ(diagnostics[3].status, XMLParser::CharReferenceError)
+    auto inOrder = diagnostics[1].errorIndex < diagnostics[2].errorIndex;
+    ASSERT_TRUE(inOrder)
+
+    // records around the bad ones are kept
+    std::string ids;
+    for (auto record : root.FirstChild().Children("r"))
+    {
+        ids += record.GetNodeAttribute("id");
+    }
+    ASSERT_EQ(ids, "1456")
+    ASSERT_EQ(root.FirstChild().FindFirstChildByTagName("r")
+                  .FindFirstChildByTagName("b").GetNodeTag(), "")
+
+    // same diagnostics without a tree
+    ASSERT_EQ(parser.Validate(str, flag), XMLParser::AttributeRepeatError)
+    ASSERT_EQ(parser.Diagnostics().size(), 4)
+
+    // unclosed elements at the end
+    parser.ParseString("<a><b>", flag);
+    ASSERT_EQ(parser.Diagnostics().size(), 1)
+    ASSERT_EQ(parser.Status(), XMLParser::TagNotMatchedError)
+    parser.ParseString(str);
+    ASSERT_EQ(parser.Status(), XMLParser::AttributeRepeatError)
+    ASSERT_TRUE(parser.Diagnostics().empty())
+    return true;
+}
+
+bool RecordSplitterTest()
+{
+    std::string feed = "<?xml version=\"1.0\"?><feed><!-- <r id=\"c\"> -->"
+                       "<r id=\"0\"><r>nested</r></r><other/>"
+                       "<r id=\"1\" v='a>b'/><![CDATA[<r>]]>";
+    for (int i = 2; i < 200; ++i)
+    {
+        feed += "<r id=\"" + std::to_string(i) + "\"><v>" + std::to_string(i)
+                + "</v></r>\n";
+    }
+    feed += "<r id=\"200\"><v></r></feed>";
+    RecordSplitter splitter("r");
+    auto records = splitter.Split(feed);
+    ASSERT_EQ(records.size(), 201)
+    ASSERT_EQ(records[0], "<r id=\"0\"><r>nested</r></r>")
+    ASSERT_EQ(records[1], "<r id=\"1\" v='a>b'/>")
+
+    std::vector<size_t> order;
+    size_t failed = 0;
+    splitter.Parse(feed, [&](size_t index, std::string_view record,
+                             XMLDocument &document,
+                             const XMLParserResult &result) {
+        order.push_back(index);
+        if (record != records[index])
+        {
+            throw std::runtime_error("wrong record");
+        }
+        if (result._status != XMLParser::NoError)
+        {
+            ++failed;
+            return;
+        }
+        auto id = document.FirstChild().GetNodeAttribute("id");
+        if (id != std::to_string(index))
+        {
+            throw std::runtime_error("wrong record");
+        }
+    }, true, 4);
+    ASSERT_EQ(order.size(), 201)
+    ASSERT_TRUE(std::is_sorted(order.begin(), order.end()))
+    ASSERT_EQ(failed, 1)
+
+    std::atomic<size_t> sum = 0;
+    splitter.Parse(feed, [&](size_t index, std::string_view,
+                             XMLDocument &, const XMLParserResult &) {
+        sum += index;
+    }, false, 4);
+    ASSERT_EQ(sum, 200 * 201 / 2)
+
+    bool thrown = false;
+    try
+    {
+        splitter.Parse(feed, [](size_t index, std::string_view, XMLDocument &,
+                                const XMLParserResult &) {
+            if (index == 10)
+            {
+                throw std::runtime_error("stop");
+            }
+        });
+    }
+    catch (const std::runtime_error &)
+    {
+        thrown = true;
+    }
+    ASSERT_TRUE(thrown)
+    return true;
+}
+
+// type, tag, attributes and content of every node, in document order
+std::string DumpTree(XMLNode node)
+{
+    std::string dump = std::to_string(node.GetNodeType()) + node.GetNodeTag();
+    for (auto &[name, value] : node.GetNodeAttributes())
+    {
+        dump += " " + name + "=" + value;
+    }
+    dump += "[" + node.GetNodeContent() + "]";
+    for (auto child : node.Children())
+    {
+        dump += "(" + DumpTree(child) + ")";
+    }
+    return dump;
+}
+
+bool FlagSpecializationTest()
+{
+    std::string str = R"(<?xml version="1.0"?><!DOCTYPE r><!--c--><?pi x?>)"
+                      R"(<r a="1&amp;2"> <![CDATA[d]]>x&lt;y<e b='&#65;'/>)"
+                      "\n <f>  </f><?p?><!--n--></r>";
+    // ParseRecover change nothing on valid input, it keep the run time
+    // flag away from the specialization it is compared with
+    auto same = [&](unsigned flag, auto parse) {
+        XMLParser runtime, compiled;
+        auto expected = DumpTree(
+            runtime.ParseString(str, flag | XMLParser::ParseRecover));
+        return runtime.Status() == XMLParser::NoError
+               && expected == DumpTree(parse(compiled))
+               && compiled.Status() == XMLParser::NoError;
+    };
+    ASSERT_TRUE(same(XMLParser::ParseFull, [&](XMLParser &parser) {
+        return parser.ParseString<XMLParser::ParseFull>(str);
+    }))
+    ASSERT_TRUE(same(XMLParser::ParseMinimal, [&](XMLParser &parser) {
+        return parser.ParseString<XMLParser::ParseMinimal>(str);
+    }))
+    constexpr auto merge = XMLParser::ParseFull | XMLParser::ParseMergeBlank;
+    ASSERT_TRUE(same(merge, [&](XMLParser &parser) {
+        return parser.ParseString<merge>(str);
+    }))
+    constexpr auto escape = XMLParser::ParseEscapeChar;
+    ASSERT_TRUE(same(escape, [&](XMLParser &parser) {
+        return parser.ParseString<escape>(str);
+    }))
+
+    XMLDocument document;
+    auto result = document.LoadString<XMLParser::ParseMinimal>("<a>&lt;</a>");
+    ASSERT_EQ(result._status, XMLParser::NoError)
+    ASSERT_EQ(document.FirstChild().GetNodeContent(), "")
+    ASSERT_EQ(document.FirstChild().FirstChild().GetNodeContent(), "&lt;")
+    result = document.LoadString<XMLParser::ParseMinimal>("<a b='1></a>");
+    ASSERT_EQ(result._status, XMLParser::AttributeSyntaxError)
+    return true;
+}
+
+bool SnapshotTest()
+{
+    std::string str = R"(<?xml version="1.0"?><!DOCTYPE r><!--c--><?pi x?>)"
+                      R"(<r a="1&amp;2" b=""><item id="7">x<![CDATA[y]]>)"
+                      R"(</item><item id="8"/><e/>text</r>)";
+    XMLDocument document;
+    ASSERT_EQ(document.LoadString(str)._status, XMLParser::NoError)
+    auto key = XMLSnapshot::Checksum(str);
+    std::string image;
+    ASSERT_EQ(XMLSnapshot::Write(document, image, key), XMLSnapshot::SnapshotOk)
+
+    XMLDocument loaded;
+    loaded.SetIndexedAttributes({"id"});
+    ASSERT_EQ(XMLSnapshot::Read(loaded, image, key), XMLSnapshot::SnapshotOk)
+    ASSERT_EQ(DumpTree(loaded), DumpTree(document))
+    ASSERT_EQ(loaded.FindById("8").GetParent().GetNodeTag(), "r")
+
+    ASSERT_EQ(XMLSnapshot::Read(loaded, image, key + 1),
+              XMLSnapshot::SnapshotStale)
+    auto damaged = image;
+    damaged.back() ^= 1;
+    ASSERT_EQ(XMLSnapshot::Read(loaded, damaged),
+              XMLSnapshot::SnapshotChecksumError)
+    ASSERT_EQ(XMLSnapshot::Read(loaded, image.substr(0, image.size() - 1)),
+              XMLSnapshot::SnapshotFormatError)
+    ASSERT_EQ(XMLSnapshot::Read(loaded, "<r/>"),
+              XMLSnapshot::SnapshotFormatError)
+    // a failed read keep the tree
+    ASSERT_EQ(DumpTree(loaded), DumpTree(document))
+
+    auto fileName = "SnapshotTest.bin";
+    ASSERT_EQ(XMLSnapshot::Save(document, fileName), XMLSnapshot::SnapshotOk)
+    XMLDocument mapped;
+    auto status = XMLSnapshot::Load(mapped, fileName);
+    std::remove(fileName);
+    ASSERT_EQ(status, XMLSnapshot::SnapshotOk)
+    ASSERT_EQ(DumpTree(mapped), DumpTree(document))
+    ASSERT_EQ(XMLSnapshot::Load(mapped, fileName),
+              XMLSnapshot::SnapshotOpenFailed)
+    return true;
+}
+
+bool CloneTest()
+{
+    std::string str = R"(<?xml version="1.0"?><!--c--><r a="1"><item id="7">)"
+                      R"(x<![CDATA[y]]><n/></item><item id="8"/>text</r>)";
+    XMLDocument source;
+    ASSERT_EQ(source.LoadString(str)._status, XMLParser::NoError)
+    auto r = source.FindFirstChildByTagName("r");
+    auto copy = r.Clone();
+    ASSERT_EQ(DumpTree(copy), DumpTree(r))
+    ASSERT_TRUE(copy.NextSibling().IsEmpty())
+    copy.FirstChild().AddNodeAttribute("id", "9");
+    copy.FirstChild().FirstChild().SetNodeContent("changed");
+    ASSERT_EQ(r.FirstChild().GetNodeAttribute("id"), "7")
+    ASSERT_EQ(r.FirstChild().FirstChild().GetNodeContent(), "x")
+    auto leaf = r.FirstChild().NextSibling().Clone();
+    ASSERT_EQ(DumpTree(leaf), DumpTree(r.FirstChild().NextSibling()))
+
+    XMLDocument target;
+    target.SetIndexedAttributes({"id"});
+    target.Import(source);
+    ASSERT_EQ(DumpTree(target), DumpTree(source))
+    ASSERT_EQ(target.FindById("8").GetParent().GetNodeTag(), "r")
+    ASSERT_EQ(source.FindById("8").GetNodeTag(), "")
+    auto item = target.FindById("7");
+    auto imported = target.Import(item);
+    ASSERT_EQ(imported.GetParent().GetNodeTag(), "")
+    ASSERT_EQ(DumpTree(imported), DumpTree(item))
+    // a document can be imported into itself
+    target.Import(target);
+    ASSERT_EQ(target.FindChildrenByTagName("r").size(), 2)
+    ASSERT_EQ(target.FindChildrenByTagName("item").size(), 2)
+    return true;
+}
+
+bool OverlayTest()
+{
+    XMLDocument base;
+    base.LoadString(
+        R"(<config><db host="a" port="1">main</db><cache/></config>)");
+    auto before = DumpTree(base);
+    {
+        XMLOverlay overlay(base);
+        auto db = overlay.Root()
+                      .FindFirstChildByTagName("config")
+                      .FindFirstChildByTagName("db");
+        db.SetNodeContent("replica");
+        db.AddNodeAttribute("host", "b");
+        db.AddNodeAttribute("user", "u");
+        XMLNode pool("pool");
+        auto added = db.AddChild(pool);
+        added.AddNodeAttribute("size", "8");
+        ASSERT_EQ(db.GetNodeContent(), "replica")
+        ASSERT_EQ(db.GetNodeAttribute("host"), "b")
+        ASSERT_EQ(db.GetNodeAttribute("port"), "1")
+        ASSERT_TRUE(db.HasNodeAttribute("user"))
+        ASSERT_EQ(db.GetNodeAttributes().size(), 3)
+        ASSERT_EQ(db.Children().size(), 2)
+        ASSERT_EQ(db.FindFirstChildByTagName("pool").GetNodeAttribute("size"),
+                  "8")
+        ASSERT_EQ(overlay.ChangedNodes(), 1)
+        // the base is untouched, other overlays see it as it is
+        ASSERT_EQ(DumpTree(base), before)
+        XMLOverlay other(base);
+        ASSERT_EQ(other.Root()
+                      .FindFirstChildByTagName("config")
+                      .FindFirstChildByTagName("db")
+                      .GetNodeContent(),
+                  "main")
+
+        XMLDocument copy;
+        overlay.CopyTo(copy);
+        auto copyDb = copy.FirstChild().FirstChild();
+        ASSERT_EQ(copyDb.GetNodeTag(), "db")
+        ASSERT_EQ(copyDb.GetNodeContent(), "replica")
+        ASSERT_EQ(copyDb.GetNodeAttribute("host"), "b")
+        ASSERT_EQ(copyDb.LastChild().GetNodeAttribute("size"), "8")
+        ASSERT_EQ(copy.FirstChild().LastChild().GetNodeTag(), "cache")
+    }
+    ASSERT_EQ(DumpTree(base), before)
+
+    // a child of the document go after the base children in the copy too
+    XMLDocument commented;
+    commented.LoadString("<!--c--><r/>");
+    XMLOverlay overlay(commented);
+    XMLNode x("x");
+    overlay.Root().AddChild(x);
+    std::string view;
+    for (auto &child : overlay.Root().Children())
+    {
+        view += child.GetNodeType() == XMLNode::NodeComment
+                    ? "#"
+                    : child.GetNodeTag();
+    }
+    ASSERT_EQ(view, "#rx")
+    XMLDocument copy;
+    overlay.CopyTo(copy);
+    ASSERT_EQ(copy.FirstChild().GetNodeType(), XMLNode::NodeComment)
+    ASSERT_EQ(copy.LastChild().GetNodeTag(), "x")
+    return true;
+}
+
+bool FreezeTest()
+{
+    std::string str = "<feed>";
+    for (int i = 0; i < 1000; ++i)
+    {
+        str += "<item id=\"" + std::to_string(i) + "\" price=\""
+               + std::to_string(i % 7) + "\">name" + std::to_string(i)
+               + "</item>";
+    }
+    str += "</feed>";
+    XMLDocument document;
+    document.SetIndexedAttributes({"id"});
+    document.LoadString(str);
+    document.Freeze();
+    auto feed = document.FirstChild();
+    ASSERT_TRUE(feed.IsFrozen())
+
+    // queries of one thread, misses included
+    auto query = [&]() {
+        long long sum = 0;
+        for (auto item : feed.Children("item"))
+        {
+            sum += item.AttributeAs<int>("price").value_or(0);
+            sum += item.GetNodeAttribute("missing").size();
+            sum += item.NextSibling().IsEmpty() ? 1 : 0;
+            sum += item.PrevSibling().IsEmpty() ? 1 : 0;
+            sum += item.FindFirstChildByTagName("none").IsEmpty() ? 1 : 0;
+        }
+        for (int i = 0; i < 1000; i += 3)
+        {
+            sum += document.FindById(std::to_string(i))
+                       .FirstChild()
+                       .GetNodeContent()
+                       .size();
+        }
+        sum += document.FindById("none").IsEmpty() ? 1 : 0;
+        return sum;
+    };
+    auto expected = query();
+    std::vector<long long> sums(8);
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < sums.size(); ++k)
+    {
+        threads.emplace_back([&, k]() {
+            for (int n = 0; n < 20; ++n)
+            {
+                sums[k] = query();
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (auto sum : sums)
+    {
+        ASSERT_EQ(sum, expected)
+    }
+
+    // range-for allocate nothing, the node freed before it is still the
+    // next one the pool give
+    XMLNode holder("holder");
+    XMLNode freed("freed");
+    holder.AddChild(freed);
+    auto *freedTag = &freed.GetNodeTag();
+    holder.RemoveChild(freed);
+    size_t items = 0;
+    for (auto child : feed)
+    {
+        items += child.IsFrozen() ? 1 : 0;
+    }
+    ASSERT_EQ(items, 1000)
+    XMLNode next("next");
+    bool reused = &next.GetNodeTag() == freedTag;
+    ASSERT_TRUE(reused)
+
+    // writes do nothing
+    auto item = feed.FirstChild();
+    item.SetNodeContent("changed");
+    item.AddNodeAttribute("id", "x");
+    XMLNode child("child");
+    item.AddChild(child);
+    feed.RemoveChild(item);
+    item.Detach();
+    ASSERT_EQ(item.GetNodeContent(), "name0")
+    ASSERT_EQ(item.GetNodeAttribute("id"), "0")
+    ASSERT_EQ(item.GetParent().GetNodeTag(), "feed")
+    ASSERT_EQ(item.FirstChild().GetNodeContent(), "name0")
+    ASSERT_TRUE(item.FirstChild().NextSibling().IsEmpty())
+    ASSERT_TRUE(document.FindById("x").IsEmpty())
+    // a empty result can't be written either
+    auto none = document.FindById("none");
+    none.SetNodeContent("x");
+    ASSERT_EQ(document.FindById("other").GetNodeContent(), "")
+
+    // the clone is a new tree
+    auto copy = feed.Clone();
+    ASSERT_FALSE(copy.IsFrozen())
+    document.Clear();
+    ASSERT_EQ(item.GetNodeContent(), "name0")
+    ASSERT_FALSE(document.IsFrozen())
+    return true;
+}
+
+bool NamespaceTest()
+{
+    std::string str =
+        "<feed xmlns=\"http://www.w3.org/2005/Atom\" xmlns:s=\"urn:s\">"
+        "<entry s:id=\"1\" id=\"a\"><title>one</title></entry>"
+        "<s:entry xmlns:s=\"urn:other\"/>"
+        "<entry xmlns=\"\"><title xml:lang=\"en\">two</title></entry>"
+        "<x:entry/>"
+        "</feed>";
+    XMLDocument document;
+    document.LoadString(str, XMLParser::ParseFull | XMLParser::ParseNamespaces);
+    auto atom = XMLNames::Namespace("http://www.w3.org/2005/Atom");
+    auto entryName = XMLName {atom, XMLNames::Local("entry")};
+    auto feed = document.FirstChild();
+    bool isFeed = feed.GetNodeName() == XMLNames::Name(
+                                            "http://www.w3.org/2005/Atom",
+                                            "feed");
+    ASSERT_TRUE(isFeed)
+    ASSERT_EQ(feed.GetNamespaceURI(), "http://www.w3.org/2005/Atom")
+
+    // only the first entry is in the Atom namespace
+    auto entries = feed.FindChildrenByName(entryName);
+    ASSERT_EQ(entries.size(), 1)
+    auto entry = entries[0];
+    ASSERT_EQ(entry.FindFirstChildByName(XMLNames::Name(
+                           "http://www.w3.org/2005/Atom", "title"))
+                  .GetNodeContent(),
+              "one")
+    ASSERT_EQ(entry.GetNodeAttribute(XMLNames::Name("urn:s", "id")), "1")
+    ASSERT_EQ(entry.GetNodeAttribute(XMLNames::Name("", "id")), "a")
+    ASSERT_EQ(entry.GetNodeAttribute(XMLNames::Name("urn:s", "none")), "")
+
+    // a inner declaration hide the outer one, and is gone after it
+    auto other = feed.FindChildrenByName(XMLNames::Name("urn:other", "entry"));
+    ASSERT_EQ(other.size(), 1)
+    ASSERT_EQ(other[0].GetNodeTag(), "s:entry")
+    auto unset = entry.NextSibling().NextSibling();
+    ASSERT_EQ(unset.GetNodeName().namespaceId, 0)
+    auto title = unset.FirstChild();
+    ASSERT_EQ(title.GetNodeName().namespaceId, 0)
+    ASSERT_EQ(title.GetNodeAttribute(
+                  XMLNames::Name(XMLNames::XMLNamespace, "lang")),
+              "en")
+    // a unbound prefix has no namespace
+    bool unbound =
+        feed.LastChild().GetNodeName() == XMLNames::Name("", "entry");
+    ASSERT_TRUE(unbound)
+
+    // names survive a clone, not a new tag
+    auto copy = entry.Clone();
+    bool sameName = copy.GetNodeName() == entryName;
+    ASSERT_TRUE(sameName)
+    ASSERT_EQ(copy.GetNodeAttribute(XMLNames::Name("urn:s", "id")), "1")
+    copy.SetNodeTag("item");
+    ASSERT_EQ(copy.GetNodeName().localId, 0)
+
+    // without the flag nothing is resolved
+    XMLDocument plain;
+    plain.LoadString(str);
+    ASSERT_TRUE(plain.FirstChild().FindChildrenByName(entryName).empty())
+    ASSERT_EQ(XMLNames::LocalName(entryName.localId), "entry")
+    return true;
+}
+
+bool BlankPolicyTest()
+{
+    std::string str = "<r>\n  <a> x </a>\n  <b>1<c/>2</b>\n  <d>  </d>\n</r>\n";
+    auto dump = [&](unsigned flag) {
+        XMLParser parser;
+        return DumpTree(parser.ParseString(str, flag));
+    };
+    // blanks between elements never make a node by default
+    ASSERT_EQ(dump(XMLParser::ParseMinimal),
+              "0[](1r[](1a[](2[x ]))(1b[](2[1])(1c[])(2[2]))(1d[]))")
+    ASSERT_EQ(dump(XMLParser::ParseTrimBlank),
+              "0[](1r[](1a[](2[x]))(1b[](2[1])(1c[])(2[2]))(1d[]))")
+    ASSERT_EQ(dump(XMLParser::ParsePreserveBlank),
+              "0[](1r[](2[\n  ])(1a[](2[ x ]))(2[\n  ])"
+              "(1b[](2[1])(1c[])(2[2]))(2[\n  ])(1d[](2[  ]))(2[\n]))")
+    // blank texts are still dropped, the others kept as they are
+    ASSERT_EQ(dump(XMLParser::ParsePreserveBlank | XMLParser::ParseMergeBlank),
+              "0[](1r[](1a[](2[ x ]))(1b[](2[1])(1c[])(2[2]))(1d[]))")
+
+    // one copy of a text, mixed content keep its data nodes
+    constexpr auto single = XMLParser::ParseFull | XMLParser::ParseTrimBlank
+                            | XMLParser::ParseTextInParent;
+    ASSERT_EQ(dump(single), "0[](1r[](1a[x])(1b[1](2[1])(1c[])(2[2]))(1d[]))")
+    XMLParser parser;
+    ASSERT_EQ(DumpTree(parser.ParseString<single>(str)), dump(single))
+    return true;
+}
+
+bool CanonicalTest()
+{
+    auto hex = [](std::string_view data) {
+        Sha256 sha;
+        sha.append(data);
+        return Sha256::Hex(sha.Finish());
+    };
+    ASSERT_EQ(hex(""), "e3b0c44298fc1c149afbf4c8996fb924"
+                       "27ae41e4649b934ca495991b7852b855")
+    ASSERT_EQ(hex("abc"), "ba7816bf8f01cfea414140de5dae2223"
+                          "b00361a396177a9cb410ff61f20015ad")
+    ASSERT_EQ(hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+              "248d6a61d20638b8e5c026930c3e6039"
+              "a33ce45964ff2167f6ecedd419db06c1")
+
+    std::string str =
+        "<?xml version=\"1.0\"?><!--head--><?pi data?>"
+        "<r xmlns=\"urn:r\" xmlns:b=\"urn:b\" xmlns:a=\"urn:a\">"
+        "<e z=\"1\" b:y=\"&lt;&quot;\" a:x=\"tab&#9;\" xmlns:a=\"urn:a\">"
+        "a&amp;b&gt;<empty/><!--c--></e>"
+        "<f xmlns=\"urn:f\"><g xmlns:c=\"urn:c\"/></f></r><!--tail-->";
+    ASSERT_NO_ERROR_PARSE_STRING(str)
+    ASSERT_EQ(XMLCanonical::ToString(document),
+              "<?pi data?>\n"
+              "<r xmlns=\"urn:r\" xmlns:a=\"urn:a\" xmlns:b=\"urn:b\">"
+              "<e z=\"1\" a:x=\"tab&#x9;\" b:y=\"&lt;&quot;\">"
+              "a&amp;b&gt;<empty></empty></e>"
+              "<f xmlns=\"urn:f\"><g xmlns:c=\"urn:c\"></g></f></r>")
+    ASSERT_EQ(XMLCanonical::ToString(document, XMLCanonical::WithComments)
+                  .substr(0, 20),
+              "<!--head-->\n<?pi dat")
+    // a subtree carry the namespaces it inherit
+    auto e = document.FindFirstChildByTagName("r").FirstChild();
+    ASSERT_EQ(XMLCanonical::ToString(e.NextSibling().FirstChild()),
+              "<g xmlns=\"urn:f\" xmlns:a=\"urn:a\" xmlns:b=\"urn:b\" "
+              "xmlns:c=\"urn:c\"></g>")
+
+    // streamed digest is the hash of the string
+    ASSERT_EQ(Sha256::Hex(XMLCanonical::Digest(document)),
+              hex(XMLCanonical::ToString(document)))
+
+    // equal subtrees have equal Hash wherever they are
+    XMLDocument other;
+    other.LoadString("<list><e z=\"1\" b:y=\"&lt;&quot;\" "
+                     "a:x=\"tab&#9;\" xmlns:a=\"urn:a\">"
+                     "a&amp;b&gt;<empty/><!--c--></e></list>");
+    auto copy = other.FirstChild().FirstChild();
+    ASSERT_EQ(copy.Hash(), e.Hash())
+    ASSERT_EQ(e.Clone().Hash(), e.Hash())
+    bool sameHash = e.Hash() == e.NextSibling().Hash();
+    ASSERT_FALSE(sameHash)
+    copy.FirstChild().SetNodeContent("a&b>!");
+    sameHash = copy.Hash() == e.Hash();
+    ASSERT_FALSE(sameHash)
+    return true;
+}
+
+bool DiffTest()
+{
+    auto feed = [](int first, int count, int changed) {
+        std::string str = "<feed>";
+        for (int i = first; i < first + count; ++i)
+        {
+            str += "<item id=\"" + std::to_string(i) + "\"><price>"
+                   + std::to_string(i == changed ? 0 : i % 7)
+                   + "</price></item>";
+        }
+        return str + "</feed>";
+    };
+    XMLDocument from, to;
+    from.SetIndexedAttributes({"id"});
+    from.LoadString(feed(0, 100, -1));
+    // item 0 removed, 100 and 101 added, a price and a attribute changed
+    to.LoadString(feed(1, 101, 50));
+    to.FirstChild().FindChildrenByTagName("item")[9].AddNodeAttribute("new",
+                                                                      "1");
+    auto kept = from.FindById("30");
+
+    auto diff = XMLDiff::Compare(from, to);
+    bool small = diff.Edits().size() < 20;
+    ASSERT_TRUE(small)
+    ASSERT_TRUE(diff.Apply(from))
+    ASSERT_EQ(from.Hash(), to.Hash())
+    // untouched nodes stay where they are, the index follow the edits
+    bool same = &from.FindById("30").GetNodeTag() == &kept.GetNodeTag();
+    ASSERT_TRUE(same)
+    ASSERT_TRUE(from.FindById("0").IsEmpty())
+    ASSERT_EQ(from.FindById("101").GetNodeAttribute("id"), "101")
+    ASSERT_EQ(from.FindById("10").GetNodeAttribute("new"), "1")
+
+    // no edit between equal documents, a script that doesn't fit fail
+    ASSERT_TRUE(XMLDiff::Compare(from, to).Empty())
+    XMLDocument other;
+    other.LoadString("<feed/>");
+    ASSERT_FALSE(diff.Apply(other))
+
+    // removed attribute and content, a different root
+    XMLDocument a, b;
+    a.LoadString("<r x=\"1\" y=\"2\">text<c/></r>");
+    b.LoadString("<s y=\"2\"/>");
+    ASSERT_TRUE(XMLDiff::Compare(a, b).Apply(a))
+    ASSERT_EQ(DumpTree(a), DumpTree(b))
+    a.LoadString("<r x=\"1\" y=\"2\">text<c/></r>");
+    b.LoadString("<r y=\"3\"><c/>text</r>");
+    ASSERT_TRUE(XMLDiff::Compare(a, b).Apply(a))
+    ASSERT_EQ(DumpTree(a), DumpTree(b))
+
+    // a parent and its only child swapped
+    for (auto [x, y] : {std::pair {"<config><db port=\"1\"/></config>",
+                                   "<db port=\"1\"><config/></db>"},
+                        std::pair {"<r><a><c/></a></r>", "<r><c><a/></c></r>"}})
+    {
+        a.LoadString(x);
+        b.LoadString(y);
+        auto swapped = XMLDiff::Compare(a, b);
+        ASSERT_FALSE(swapped.Empty())
+        ASSERT_TRUE(swapped.Apply(a))
+        ASSERT_EQ(a.Hash(), b.Hash())
+    }
+    return true;
+}
+
+bool DocumentCacheTest()
+{
+    auto fileName = "DocumentCacheTest.xml";
+    auto other = "DocumentCacheTest2.xml";
+    std::ofstream(fileName) << "<feed><item id=\"1\">a</item></feed>";
+    std::ofstream(other) << "<other/>";
+    XMLDocumentCache cache(1 << 20);
+    cache.SetIndexedAttributes({"id"});
+    auto first = cache.Load(fileName);
+    bool parsed = first != nullptr;
+    ASSERT_TRUE(parsed)
+    ASSERT_TRUE(first->IsFrozen())
+    ASSERT_EQ(first->FindById("1").GetNodeContent(), "a")
+
+    // unchanged, shared by every thread
+    std::vector<std::shared_ptr<const XMLDocument>> loaded(4);
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < loaded.size(); ++k)
+    {
+        threads.emplace_back([&, k]() {
+            for (int n = 0; n < 50; ++n)
+            {
+                loaded[k] = cache.Load(n % 2 == 0 ? fileName : other);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (auto &document : loaded)
+    {
+        ASSERT_EQ(document->FirstChild().GetNodeTag(), "other")
+    }
+    bool same = cache.Load(fileName) == first;
+    ASSERT_TRUE(same)
+    auto statistics = cache.GetStatistics();
+    // threads may both miss a file not loaded yet
+    ASSERT_EQ(statistics.hits + statistics.misses, 202)
+    ASSERT_EQ(statistics.documents, 2)
+
+    // touched with the same bytes, then changed
+    auto touched = std::filesystem::last_write_time(fileName)
+                   + std::chrono::seconds(5);
+    std::filesystem::last_write_time(fileName, touched);
+    same = cache.Load(fileName) == first;
+    ASSERT_TRUE(same)
+    ASSERT_EQ(cache.GetStatistics().revalidations, 1)
+    std::ofstream(fileName) << "<feed><item id=\"1\">changed</item></feed>";
+    auto changed = cache.Load(fileName);
+    ASSERT_EQ(changed->FindById("1").GetNodeContent(), "changed")
+    ASSERT_EQ(first->FindById("1").GetNodeContent(), "a")
+    ASSERT_EQ(cache.GetStatistics().misses, statistics.misses + 1)
+
+    // over the budget the least recently used go
+    XMLDocumentCache small(1);
+    std::weak_ptr<const XMLDocument> evicted = small.Load(fileName);
+    auto *rootTag = &evicted.lock()->GetNodeTag();
+    small.Load(other);
+    statistics = small.GetStatistics();
+    ASSERT_EQ(statistics.documents, 1)
+    ASSERT_EQ(statistics.evictions, 1)
+    // held by nobody, its nodes are back in the pool, the next node made
+    // take the last one freed, its root
+    ASSERT_TRUE(evicted.expired())
+    XMLNode reused("reused");
+    same = &reused.GetNodeTag() == rootTag;
+    ASSERT_TRUE(same)
+
+    XMLParser::ParseStatus status;
+    std::ofstream(other) << "<other>";
+    bool failed = cache.Load(other, status) == nullptr;
+    ASSERT_TRUE(failed)
+    ASSERT_EQ(status, XMLParser::TagNotMatchedError)
+    std::remove(fileName);
+    std::remove(other);
+    failed = cache.Load(fileName, status) == nullptr;
+    ASSERT_TRUE(failed)
+    ASSERT_EQ(status, XMLParser::FileOpenFailed)
+    return true;
+}
+
+bool DocumentClearTest()
+{
+    XMLDocument document;
+    document.SetIndexedAttributes({"id"});
+    ASSERT_EQ(document.LoadString("<a id=\"1\"><b id=\"2\"/></a>")._status,
+              XMLParser::NoError)
+    document.Clear();
+    ASSERT_EQ(document.FindById("2").GetNodeType(), XMLNode::NullNode)
+    ASSERT_TRUE(document.Children().empty())
+    // freed nodes are reused by the next load
+    ASSERT_EQ(document.LoadString("<c id=\"3\"/>")._status, XMLParser::NoError)
+    ASSERT_EQ(document.FindById("3").GetNodeTag(), "c")
+    return true;
+}
+
+// tokens of reader as "type:name=value" lines, attributes after start tags
+std::string ReadTokens(XMLReader &reader, std::string_view input = {},
+                       size_t chunkSize = 0)
+{
+    std::string tokens;
+    size_t fed = 0;
+    while (true)
+    {
+        auto token = reader.Next();
+        if (token.type == XMLToken::NeedInput)
+        {
+            if (fed >= input.size())
+            {
+                reader.Finish();
+            }
+            else
+            {
+                reader.Feed(input.substr(fed, chunkSize));
+                fed += chunkSize;
+            }
+            continue;
+        }
+        if (token.type == XMLToken::End || token.type == XMLToken::Error)
+        {
+            return tokens + std::to_string(token.type);
+        }
+        tokens += std::to_string(token.type) + ":" + std::string(token.name)
+                  + "=" + std::string(token.value) + "\n";
+        if (token.type == XMLToken::StartElement)
+        {
+            for (auto &attribute : reader.Attributes())
+            {
+                tokens += " " + std::string(attribute.name) + "="
+                          + std::string(attribute.value) + "\n";
+            }
+        }
+    }
+}
+
+bool XMLReaderTest()
+{
+    std::string str = "<?xml version=\"1.0\"?><!DOCTYPE a [<!ENTITY e \"E\">]>"
+                      "<!-- c --><a x=\"1&amp;2\" y='&e;'>text &lt; &e;"
+                      "<b/><?pi v?><c><![CDATA[<raw>]]></c> tail </a>";
+    XMLReader reader(str);
+    auto whole = ReadTokens(reader);
+    std::string expect = "9:=\n"
+                         "10:=a [<!ENTITY e \"E\">]\n"
+                         "7:= c \n"
+                         "3:a=\n x=1&2\n y=E\n"
+                         "5:=text < E\n"
+                         "3:b=\n4:b=\n"
+                         "8:pi=v\n"
+                         "3:c=\n6:=<raw>\n4:c=\n"
+                         "5:=tail \n"
+                         "4:a=\n0";
+    ASSERT_EQ(whole, expect)
+    // the same tokens whatever the chunks are
+    for (size_t chunkSize : {1, 3, 7, 64})
+    {
+        XMLReader chunked;
+        ASSERT_EQ(ReadTokens(chunked, str, chunkSize), expect)
+    }
+
+    XMLReader bad("<a><b></a>");
+    ASSERT_EQ(ReadTokens(bad), "3:a=\n3:b=\n2")
+    ASSERT_EQ(bad.Status(), XMLParser::TagNotMatchedError)
+    ASSERT_EQ(bad.ErrorIndex(), 9)
+    XMLReader chunkedBad;
+    ReadTokens(chunkedBad, "<a>\n<b></a>", 2);
+    ASSERT_EQ(chunkedBad.ErrorIndex(), 10)
+    ASSERT_EQ(reader.ErrorIndex(), std::string_view::npos)
+
+    // only the open tags are kept, not the document
+    std::string deep;
+    for (int i = 0; i < 1000; ++i)
+    {
+        deep += "<n>";
+    }
+    XMLReader depth(deep);
+    for (int i = 0; i < 1000; ++i)
+    {
+        depth.Next();
+    }
+    ASSERT_EQ(depth.Depth(), 1000)
+    ASSERT_EQ(depth.Next().type, XMLToken::Error)
+    return true;
+}
+
+struct BindItem
+{
+    int id = 0;
+    std::string name;
+    double price = 0;
+    bool stock = false;
+    std::vector<std::string> tags;
+    std::vector<bool> flags;
+};
+
+struct BindOrder
+{
+    unsigned long long number = 0;
+    std::string note;
+    std::vector<BindItem> items;
+};
+
+template<>
+struct Craft::XMLSchema<BindItem>
+{
+    static constexpr std::string_view tag = "item";
+    static constexpr auto fields = std::tuple {
+        XMLAttribute("id", &BindItem::id), XMLChild("name", &BindItem::name),
+        XMLChild("price", &BindItem::price),
+        XMLAttribute("stock", &BindItem::stock),
+        XMLChild("tag", &BindItem::tags), XMLChild("flag", &BindItem::flags)};
+};
+
+template<>
+struct Craft::XMLSchema<BindOrder>
+{
+    static constexpr std::string_view tag = "order";
+    static constexpr auto fields =
+        std::tuple {XMLAttribute("number", &BindOrder::number),
+                    XMLText(&BindOrder::note),
+                    XMLChild("item", &BindOrder::items)};
+};
+
+bool XMLBinderTest()
+{
+    BindOrder order;
+    auto result = XMLBinder::Parse(
+        "<?xml version=\"1.0\"?><order number=\"18446744073709551615\">"
+        "<item id=\"7\" stock=\"true\"><name>pen &amp; ink</name>"
+        "<price> 2.5 </price><tag>a</tag><unknown><tag>x</tag></unknown>"
+        "<tag><![CDATA[b]]></tag><flag>true</flag><flag>0</flag></item>"
+        "rush<item id=\"-3\"><price>1e3</price></item></order>",
+        order);
+    ASSERT_EQ(result._status, XMLParser::NoError)
+    ASSERT_EQ(order.number, 18446744073709551615ULL)
+    ASSERT_EQ(order.note, "rush")
+    ASSERT_EQ(order.items.size(), 2)
+    ASSERT_EQ(order.items[0].id, 7)
+    ASSERT_EQ(order.items[0].name, "pen & ink")
+    ASSERT_EQ(order.items[0].price, 2.5)
+    ASSERT_TRUE(order.items[0].stock)
+    ASSERT_EQ(order.items[0].tags.size(), 2)
+    ASSERT_EQ(order.items[0].tags[1], "b")
+    ASSERT_EQ(order.items[0].flags.size(), 2)
+    ASSERT_TRUE(order.items[0].flags[0])
+    ASSERT_FALSE(order.items[0].flags[1])
+    ASSERT_EQ(order.items[1].id, -3)
+    ASSERT_EQ(order.items[1].price, 1000)
+    ASSERT_FALSE(order.items[1].stock)
+
+    BindItem item;
+    result = XMLBinder::Parse("<item>\n<price>cheap</price></item>", item);
+    ASSERT_EQ(result._status, XMLParser::ValueConversionError)
+    ASSERT_EQ(result.Line(), 2)
+    result = XMLBinder::Parse("<item id=\"300000000000\"/>", item);
+    ASSERT_EQ(result._status, XMLParser::ValueConversionError)
+    result = XMLBinder::Parse("<item><name>a</item>", item);
+    ASSERT_EQ(result._status, XMLParser::TagNotMatchedError)
+
+    // the root must be the tag of the schema, only it is bound
+    result = XMLBinder::Parse("<other id=\"5\"/>", item);
+    ASSERT_EQ(result._status, XMLParser::RootMismatchError)
+    ASSERT_EQ(result.Message(),
+              "RootMismatchError at line 1, column 16: <other id=\"5\"/>")
+    result = XMLBinder::Parse("<item/>", order);
+    ASSERT_EQ(result._status, XMLParser::RootMismatchError)
+    result = XMLBinder::Parse("<item id=\"1\"/><item id=\"7\"/>", item);
+    ASSERT_EQ(result._status, XMLParser::NoError)
+    ASSERT_EQ(item.id, 1)
+    return true;
+}
+
 inline std::map<std::string, std::function<bool(void)>> testFunction;
 
 void TestBind()
 {
     testFunction["NodeStructTest"] = NodeStructTest;
+    testFunction["NodeMutationTest"] = NodeMutationTest;
 
     testFunction["PrologTest"] = PrologTest;
     testFunction["PrologErrorTest"] = PrologErrorTest;
@@ -352,6 +1751,27 @@ void TestBind()
     testFunction["TagSpaceTest"] = TagSpaceTest;
     testFunction["TagBadCloseError"] = TagBadCloseError;
     testFunction["TagNotMatchedErrorTest"] = TagNotMatchedErrorTest;
+    testFunction["MaxDepthTest"] = MaxDepthTest;
+    testFunction["ValidateTest"] = ValidateTest;
+    testFunction["SkippedNodeTest"] = SkippedNodeTest;
+    testFunction["ErrorLocationTest"] = ErrorLocationTest;
+    testFunction["RecoverTest"] = RecoverTest;
+
+    testFunction["RecordSplitterTest"] = RecordSplitterTest;
+    testFunction["DocumentClearTest"] = DocumentClearTest;
+    testFunction["FlagSpecializationTest"] = FlagSpecializationTest;
+    testFunction["SnapshotTest"] = SnapshotTest;
+    testFunction["CloneTest"] = CloneTest;
+    testFunction["OverlayTest"] = OverlayTest;
+    testFunction["FreezeTest"] = FreezeTest;
+    testFunction["NamespaceTest"] = NamespaceTest;
+    testFunction["BlankPolicyTest"] = BlankPolicyTest;
+    testFunction["CanonicalTest"] = CanonicalTest;
+    testFunction["DiffTest"] = DiffTest;
+    testFunction["DocumentCacheTest"] = DocumentCacheTest;
+
+    testFunction["XMLReaderTest"] = XMLReaderTest;
+    testFunction["XMLBinderTest"] = XMLBinderTest;
 
     testFunction["CommentTest"] = CommentTest;
     testFunction["CommentSyntaxErrorTest"] = CommentSyntaxErrorTest;
@@ -359,6 +1779,7 @@ void TestBind()
     testFunction["OneAttributeTest"] = OneAttributeTest;
     testFunction["AttributeQuoteTest"] = AttributeQuoteTest;
     testFunction["MultiAttributeTest"] = MultiAttributeTest;
+    testFunction["NumericAccessorTest"] = NumericAccessorTest;
     testFunction["AttributeErrorTest"] = AttributeErrorTest;
 
     testFunction["DOCTYPETest"] = DoctypeTest;
@@ -369,6 +1790,19 @@ void TestBind()
     testFunction["OperatorOverLoadTest"] = OperatorOverLoadTest;
 
     testFunction["EntityReferenceTest"] = EntityReferenceTest;
+    testFunction["CharReferenceErrorTest"] = CharReferenceErrorTest;
+    testFunction["DoctypeEntityTest"] = DoctypeEntityTest;
+    testFunction["EntityExpansionLimitTest"] = EntityExpansionLimitTest;
+
+    testFunction["MemoryPoolPolicyTest"] = MemoryPoolPolicyTest;
+
+    testFunction["AttributeIndexTest"] = AttributeIndexTest;
+
+    testFunction["NodeRangeTest"] = NodeRangeTest;
+    testFunction["NodeGetterReferenceTest"] = NodeGetterReferenceTest;
+
+    testFunction["EncodingTest"] = EncodingTest;
+    testFunction["ValidateUTF8Test"] = ValidateUTF8Test;
 }
 #define RED "\033[31m" /* Red */
 void Test()